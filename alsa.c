@@ -16,14 +16,16 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <pthread.h>
+#include <poll.h>
 #include <alsa/asoundlib.h>
 #include <math.h>
 
 #include "config.h"
-#include "sym-queue.h"
 #include "threads.h"
 #include "alsa.h"
+#include "audio.h"
+#include "prof.h"
+#include "rtlog.h"
 
 #ifdef DEBUG
 
@@ -34,17 +36,17 @@
 
 #if (VERBOSITY == 1)
 #define SND_SETUP(fn, err, val)		do {if (err < 0) snd_show(#fn, err, (int)val);} while (0)
-#define SND_IO(fn, err, val)		do {if (err < 0) snd_show(#fn, err, (int)val);} while (0)
+#define SND_IO(fn, err, val)		do {if (err < 0) snd_log(#fn, err, (int)val);} while (0)
 #endif
 
 #if (VERBOSITY == 2)
 #define SND_SETUP(fn, err, val)		snd_show(#fn, err, (int)val)
-#define SND_IO(fn, err, val)		do {if (err < 0) snd_show(#fn, err, (int)val);} while (0)
+#define SND_IO(fn, err, val)		do {if (err < 0) snd_log(#fn, err, (int)val);} while (0)
 #endif
 
 #if (VERBOSITY >= 3)
 #define SND_SETUP(fn, err, val)		snd_show(#fn, err, (int)val)
-#define SND_IO(fn, err, val)		snd_show(#fn, err, (int)val)
+#define SND_IO(fn, err, val)		snd_log(#fn, err, (int)val)
 #endif
 
 #define SND_ERR(fn, err, val)		snd_err(#fn, err, (int)val)
@@ -71,6 +73,32 @@ static void snd_show(const char *fn, int err, int val)
 			fprintf(stderr, "%s(%d) returned=%d\n", fn, val, err);
 	}
 }
+
+/*
+ * snd_show() for the audio thread: through the rtlog ring
+ * rather than straight to stderr
+ */
+static void snd_log(const char *fn, int err, int val)
+{
+	if (err == 0) {
+		if (val == SND_IGN_VAL)
+			rtlog("%s() Success\n", fn);
+		else
+			rtlog("%s(%d) Success\n", fn, val);
+	}
+	else if (err < 0) {
+		if (val == SND_IGN_VAL)
+			rtlog("Error: %s() err=%d (%s)\n", fn, err, snd_strerror(err));
+		else
+			rtlog("Error: %s(%d) err=%d (%s)\n", fn, val, err, snd_strerror(err));
+	}
+	else {
+		if (val == SND_IGN_VAL)
+			rtlog("%s() returned=%d\n", fn, err);
+		else
+			rtlog("%s(%d) returned=%d\n", fn, val, err);
+	}
+}
 #else
 
 #define SND_SETUP(fn, rc, val)		do {} while (0)
@@ -78,79 +106,68 @@ static void snd_show(const char *fn, int err, int val)
 
 #endif
 
-#define ALSADEV			"hw:0,3"
 #define SUB_DIR_EXACT		0
 
-#define QUEUE_SLOTS		4
-#define QUEUE_SIZE		(QUEUE_SLOTS * PERIOD_SIZE)
-
-#ifdef QUEUE_STATS
-#define QSTAT_HIST(_q)		(_q).qs.level_cnts[(_q).len / PERIOD_SIZE]++
-#define QSTAT_OVERRUN(_q)	(_q).qs.overrun_cnt++
-#define QSTAT_UNDERRUN(_q)	(_q).qs.underrun_cnt++
-#else
-#define QSTAT_HIST(_q)		do {} while (0)
-#define QSTAT_OVERRUN(_q)	do {} while (0)
-#define QSTAT_UNDERRUN(_q)	do {} while (0)
-#endif
-
-#define QINCP(_q, _p)		do {(_q)._p += PERIOD_SIZE; \
-				    if (((_q)._p - (_q).buf) == QUEUE_SIZE) \
-					(_q)._p = (_q).buf;} \
-				while (0)
-#define QINCLEN(_q)		do {(_q).len += PERIOD_SIZE; QSTAT_HIST(_q);} while (0)
-#define QDECLEN(_q)		do {(_q).len -= PERIOD_SIZE; QSTAT_HIST(_q);} while (0)
+#define ALSA_STOPPING		2	/* the session is ending; not 0 or 1 */
+#define RESUME_POLL_MS		100	/* retry snd_pcm_resume() after a suspend */
 
-#define XRUN_NONE		0
-#define XRUN_OVERRUN		1
-#define XRUN_UNDERRUN		2
-
-static snd_pcm_t *pdev;
+#define MAX_POLL_FDS		8
 
-static pthread_mutex_t play_lock = PTHREAD_MUTEX_INITIALIZER;
-
-#ifdef QUEUE_STATS
-struct queue_stats {
-	unsigned int level_cnts[QUEUE_SLOTS];
-	unsigned int underrun_cnt;
-	unsigned int overrun_cnt;
-	unsigned int xrun_cnt;
-};
-#endif
+/*
+ * Tried in order after the one asked for with --format.  All
+ * of them are converted from float, so the widest integer
+ * format wins; FLOAT_LE is rarely native, and S16_LE is the
+ * one everything takes.
+ */
+static const int format_prefs[] = {PCM_S32, PCM_S24_3, PCM_FLOAT, PCM_S16};
 
-struct queue_struct {
-	pthread_mutex_t lock;
-	pthread_cond_t wakeup;
-	unsigned char buf[QUEUE_SIZE];
-	unsigned char *head;
-	unsigned char *tail;
-	unsigned int len;
-#ifdef QUEUE_STATS
-	struct queue_stats qs;
-#endif
+static const snd_pcm_format_t snd_formats[N_PCM_FORMATS] = {
+	[PCM_S16] = SND_PCM_FORMAT_S16_LE,
+	[PCM_S24_3] = SND_PCM_FORMAT_S24_3LE,
+	[PCM_S32] = SND_PCM_FORMAT_S32_LE,
+	[PCM_FLOAT] = SND_PCM_FORMAT_FLOAT_LE,
 };
 
-static struct queue_struct pq;		/* playback queue */
+static snd_pcm_t *pdev;
+static int mmap_mode;		/* render straight into the DMA buffer */
+static struct pollfd pfds[MAX_POLL_FDS];
+static int n_pfds;
+static int tstamp_ok;		/* htimestamp is CLOCK_MONOTONIC */
+static snd_pcm_uframes_t buffer_frames;	/* as negotiated */
 
-#ifdef QUEUE_STATS
-static void print_qstats(struct queue_stats *qs)
+/*
+ * The format asked for, if the device takes it, otherwise the
+ * first of format_prefs[] that it does
+ */
+static int alsa_pick_format(snd_pcm_t *adev, snd_pcm_hw_params_t *hw_params)
 {
 	int i;
 
-	printf("  queue-level histogram:\n");
-	for (i = 0; i < QUEUE_SLOTS; i++) {
-		printf("       level%d: %d\n", i, qs->level_cnts[i]);
+	if ((settings.format >= 0) &&
+	    (snd_pcm_hw_params_test_format(adev, hw_params, snd_formats[settings.format]) == 0))
+		return settings.format;
+
+	for (i = 0; i < N_ARRAY(format_prefs); i++) {
+		if (snd_pcm_hw_params_test_format(adev, hw_params, snd_formats[format_prefs[i]]) == 0)
+			return format_prefs[i];
 	}
-	printf("    underruns: %d\n", qs->underrun_cnt);
-	printf("     overruns: %d\n", qs->overrun_cnt);
-	printf("      hw_xrun: %d\n", qs->xrun_cnt);
-	printf("\n");
+	return -1;
 }
-#endif
 
+/*
+ * Take the nearest rate and channel count the device offers,
+ * and the first format it takes, and write them back to
+ * settings: the symbols are then rendered to match.
+ */
 static int alsa_setup_hw(snd_pcm_t *adev)
 {
 	snd_pcm_hw_params_t *hw_params;
+	snd_pcm_uframes_t period;
+	unsigned int periods;
+	unsigned int rate;
+	unsigned int chans;
+	int format;
+	int dir;
 	int rc = 0;
 
 	do {
@@ -164,33 +181,82 @@ static int alsa_setup_hw(snd_pcm_t *adev)
 		SND_SETUP(snd_pcm_hw_params_set_periods_integer, rc, SND_IGN_VAL);
 		if (rc) break;
 
-		rc = snd_pcm_hw_params_set_access(adev, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED);
-		SND_SETUP(snd_pcm_hw_params_set_access, rc, SND_PCM_ACCESS_RW_INTERLEAVED);
-		if (rc) break;
+		mmap_mode = 0;
+		if (settings.mmap) {
+			rc = snd_pcm_hw_params_set_access(adev, hw_params, SND_PCM_ACCESS_MMAP_INTERLEAVED);
+			SND_SETUP(snd_pcm_hw_params_set_access, rc, SND_PCM_ACCESS_MMAP_INTERLEAVED);
+			if (rc == 0)
+				mmap_mode = 1;
+			else
+				fprintf(stderr, "%s: mmap access not supported, using read/write\n",
+					settings.alsadev);
+		}
+		if (!mmap_mode) {
+			rc = snd_pcm_hw_params_set_access(adev, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED);
+			SND_SETUP(snd_pcm_hw_params_set_access, rc, SND_PCM_ACCESS_RW_INTERLEAVED);
+			if (rc) break;
+		}
 
-		rc = snd_pcm_hw_params_set_format(adev, hw_params, SND_PCM_FORMAT_S16_LE);
-		SND_SETUP(snd_pcm_hw_params_set_format, rc, SND_PCM_FORMAT_S16_LE);
+		format = alsa_pick_format(adev, hw_params);
+		if (format < 0) {
+			fprintf(stderr, "%s: no usable sample format\n", settings.alsadev);
+			rc = -EINVAL;
+			break;
+		}
+		rc = snd_pcm_hw_params_set_format(adev, hw_params, snd_formats[format]);
+		SND_SETUP(snd_pcm_hw_params_set_format, rc, snd_formats[format]);
 		if (rc) break;
 
-		rc = snd_pcm_hw_params_set_rate(adev, hw_params, SAMPLE_RATE, SUB_DIR_EXACT);
-		SND_SETUP(snd_pcm_hw_params_set_rate, rc, SAMPLE_RATE);
+		/* no resampling in alsa-lib: we render at the device's rate */
+		snd_pcm_hw_params_set_rate_resample(adev, hw_params, 0);
+		rate = settings.sample_rate;
+		dir = SUB_DIR_EXACT;
+		rc = snd_pcm_hw_params_set_rate_near(adev, hw_params, &rate, &dir);
+		SND_SETUP(snd_pcm_hw_params_set_rate_near, rc, rate);
 		if (rc) break;
 
-		rc = snd_pcm_hw_params_set_channels(adev, hw_params, CHANNELS);
-		SND_SETUP(snd_pcm_hw_params_set_channels, rc, CHANNELS);
+		chans = settings.n_chans;
+		rc = snd_pcm_hw_params_set_channels_near(adev, hw_params, &chans);
+		SND_SETUP(snd_pcm_hw_params_set_channels_near, rc, chans);
 		if (rc) break;
+		if ((chans < 1) || (chans > MAX_CHANNELS)) {
+			rc = -EINVAL;
+			break;
+		}
 
-		rc = snd_pcm_hw_params_set_period_size(adev, hw_params, FRAMES_PER_PERIOD, SUB_DIR_EXACT);
-		SND_SETUP(snd_pcm_hw_params_set_period_size, rc, FRAMES_PER_PERIOD);
+		/* periods of other sizes still work, with more wake-ups */
+		period = FRAMES_PER_PERIOD;
+		dir = SUB_DIR_EXACT;
+		rc = snd_pcm_hw_params_set_period_size_near(adev, hw_params, &period, &dir);
+		SND_SETUP(snd_pcm_hw_params_set_period_size_near, rc, period);
 		if (rc) break;
 
-		rc = snd_pcm_hw_params_set_periods(adev, hw_params, PERIODS_PER_BUFFER, SUB_DIR_EXACT);
-		SND_SETUP(snd_pcm_hw_params_set_periods, rc, FRAMES_PER_BUFFER);
+		periods = PERIODS_PER_BUFFER;
+		dir = SUB_DIR_EXACT;
+		rc = snd_pcm_hw_params_set_periods_near(adev, hw_params, &periods, &dir);
+		SND_SETUP(snd_pcm_hw_params_set_periods_near, rc, periods);
 		if (rc) break;
 
 		rc = snd_pcm_hw_params(adev, hw_params);
 		SND_SETUP(snd_pcm_hw_params, rc, SND_IGN_VAL);
 		if (rc) break;
+
+		rc = snd_pcm_hw_params_get_buffer_size(hw_params, &buffer_frames);
+		SND_SETUP(snd_pcm_hw_params_get_buffer_size, rc, buffer_frames);
+		if (rc) break;
+
+		if ((settings.format >= 0) && (format != settings.format))
+			fprintf(stderr, "%s: %s not supported, using %s\n", settings.alsadev,
+				pcm_format_name(settings.format), pcm_format_name(format));
+		if (rate != (unsigned int)settings.sample_rate)
+			fprintf(stderr, "%s: %0.0f Hz not supported, using %u Hz\n",
+				settings.alsadev, settings.sample_rate, rate);
+		if (chans != settings.n_chans)
+			fprintf(stderr, "%s: %d channels not supported, using %u\n",
+				settings.alsadev, settings.n_chans, chans);
+		settings.format = format;
+		settings.sample_rate = rate;
+		settings.n_chans = chans;
 	} while (0);
 
 #ifdef DEBUG
@@ -238,8 +304,8 @@ static int alsa_setup_sw(snd_pcm_t *adev)
 		SND_SETUP(snd_pcm_sw_params_set_start_threshold, rc, 0);
 		if (rc) break;
 
-		rc = snd_pcm_sw_params_set_stop_threshold(adev, sw_params, FRAMES_PER_BUFFER);
-		SND_SETUP(snd_pcm_sw_params_set_stop_threshold, rc, FRAMES_PER_BUFFER);
+		rc = snd_pcm_sw_params_set_stop_threshold(adev, sw_params, buffer_frames);
+		SND_SETUP(snd_pcm_sw_params_set_stop_threshold, rc, buffer_frames);
 		if (rc) break;
 
 		rc = snd_pcm_sw_params_set_silence_size(adev, sw_params, 0);
@@ -253,6 +319,13 @@ static int alsa_setup_sw(snd_pcm_t *adev)
 		SND_SETUP(snd_pcm_sw_params_set_avail_min, rc, FRAMES_PER_PERIOD);
 		if (rc) break;
 
+		/* for snd_pcm_htimestamp(); alsa_stamp() copes without them */
+		rc = snd_pcm_sw_params_set_tstamp_mode(adev, sw_params, SND_PCM_TSTAMP_ENABLE);
+		SND_SETUP(snd_pcm_sw_params_set_tstamp_mode, rc, SND_PCM_TSTAMP_ENABLE);
+		rc = snd_pcm_sw_params_set_tstamp_type(adev, sw_params, SND_PCM_TSTAMP_TYPE_MONOTONIC);
+		SND_SETUP(snd_pcm_sw_params_set_tstamp_type, rc, SND_PCM_TSTAMP_TYPE_MONOTONIC);
+		tstamp_ok = (rc == 0);
+
 		rc = snd_pcm_sw_params(adev, sw_params);
 		SND_SETUP(snd_pcm_sw_params, rc, SND_IGN_VAL);
 		if (rc) break;
@@ -262,16 +335,15 @@ static int alsa_setup_sw(snd_pcm_t *adev)
 	return rc;
 }
 
-static int alsa_setup(void)
+static int alsa_setup(const char *dev)
 {
 	int rc = 0;
 
 	do {
-		rc = snd_pcm_open(&pdev, ALSADEV, SND_PCM_STREAM_PLAYBACK, SND_PCM_NONBLOCK);
+		/* left non-blocking: alsa_wait() is the only place to sleep */
+		rc = snd_pcm_open(&pdev, dev, SND_PCM_STREAM_PLAYBACK, SND_PCM_NONBLOCK);
 		SND_SETUP(snd_pcm_open, rc, SND_PCM_STREAM_PLAYBACK);
 		if (rc < 0) break;
-		rc = snd_pcm_nonblock(pdev, 0);
-		SND_SETUP(snd_pcm_nonblock, rc, 0);
 
 		rc = alsa_setup_hw(pdev);
 		if (rc < 0) break;
@@ -307,14 +379,6 @@ static int alsa_stop(void)
 	return rc;
 }
 
-static int alsa_restart(void)
-{
-	alsa_stop();
-	alsa_start();
-
-	return 0;
-}
-
 static int alsa_close(void)
 {
 	snd_pcm_close(pdev);
@@ -322,57 +386,129 @@ static int alsa_close(void)
 	return 0;
 }
 
-static int alsa_xrun_recovery(void)
+/*
+ * Sleep until there is room for a period, or the session ends.
+ * Returns 1 if writable, 0 on timeout, ALSA_STOPPING when
+ * stopping and an ALSA error code on error (-EPIPE for an xrun).
+ */
+static int alsa_wait(int timeout_ms)
 {
-	static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+	unsigned short revents;
 	int rc;
 
-	if (pthread_mutex_trylock(&lock) != 0) {
-		/* already locked */
-		DPRINTF("already in recovery\n");
-		usleep(1000);
-		return 1;
+	rc = audio_poll(pfds, n_pfds, timeout_ms);
+	if (rc < 0)
+		return ALSA_STOPPING;
+	if (rc == 0)
+		return 0;
+
+	rc = snd_pcm_poll_descriptors_revents(pdev, pfds, n_pfds, &revents);
+	SND_IO(snd_pcm_poll_descriptors_revents, rc, SND_IGN_VAL);
+	if (rc < 0)
+		return rc;
+	if (revents & POLLERR) {
+		switch (snd_pcm_state(pdev)) {
+		case SND_PCM_STATE_XRUN:
+			return -EPIPE;
+		case SND_PCM_STATE_SUSPENDED:
+			return -ESTRPIPE;
+		default:
+			return -EIO;
+		}
 	}
-	/* recovery lock held */
-
-	pthread_mutex_lock(&play_lock);
-
-	rc = alsa_restart();
 
-	pthread_mutex_unlock(&play_lock);
-
-	pthread_mutex_unlock(&lock);
+	return (revents & POLLOUT) ? 1 : 0;
+}
 
-	return rc;
+/*
+ * Tell the latency tracker how far the DAC is behind what has
+ * been written
+ */
+static void alsa_stamp(void)
+{
+	snd_pcm_uframes_t avail;
+	snd_pcm_sframes_t delay;
+	snd_htimestamp_t ts;
+	struct timespec now;
+
+	if (tstamp_ok && (snd_pcm_htimestamp(pdev, &avail, &ts) == 0) &&
+	    (ts.tv_sec || ts.tv_nsec)) {
+		audio_timestamp(ts.tv_sec * 1000000000LL + ts.tv_nsec,
+			(long)buffer_frames - (long)avail);
+		return;
+	}
+	if (snd_pcm_delay(pdev, &delay) == 0) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		audio_timestamp(now.tv_sec * 1000000000LL + now.tv_nsec, delay);
+	}
 }
 
-static void queue_init(struct queue_struct *q)
+static long long alsa_now(void)
 {
-	memset(q, 0, sizeof(*q));
-	pthread_mutex_init(&q->lock, NULL);
-	pthread_cond_init(&q->wakeup, NULL);
-	q->head = q->buf;
-	q->tail = q->buf;
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
 }
 
-static void queue_destroy(struct queue_struct *q)
+/*
+ * Recover from an xrun (-EPIPE) or a suspend (-ESTRPIPE) and
+ * leave the PCM prepared, without dropping anything that has
+ * not been written yet: the caller writes the period it holds
+ * again, and the render-ahead ring follows it, so the symbol
+ * stream carries on from the same sample.
+ *
+ * Returns 0 when recovered, ALSA_STOPPING if the session ended
+ * while waiting for a resume, or the error it could not handle.
+ */
+static int alsa_recover(int err)
 {
-	pthread_mutex_destroy(&q->lock);
-	pthread_cond_destroy(&q->wakeup);
-	q->head = NULL;
-	q->tail = NULL;
-	q->len = 0;
+	snd_pcm_state_t state;
+	long long t;
+	int rc;
+
+	t = alsa_now();
+	state = snd_pcm_state(pdev);
+	audio_xrun();
+	rtlog("xrun: %s in state %s, %d of %d periods rendered ahead\n",
+		(err == -EPIPE) ? "underrun" : (err == -ESTRPIPE) ? "suspend" : snd_strerror(err),
+		snd_pcm_state_name(state), audio_level(), settings.ahead);
+
+	if (err == -ESTRPIPE) {
+		/* the device may need a while to come back */
+		while ((rc = snd_pcm_resume(pdev)) == -EAGAIN) {
+			if (audio_poll(pfds, 0, RESUME_POLL_MS) < 0)
+				return ALSA_STOPPING;
+		}
+		if (rc < 0)
+			rc = snd_pcm_prepare(pdev);
+	}
+	else {
+		rc = snd_pcm_recover(pdev, err, 1);
+	}
+	SND_IO(snd_pcm_recover, rc, err);
+
+	if (rc < 0)
+		rtlog("xrun: recovery failed: %s\n", snd_strerror(rc));
+	else
+		rtlog("xrun: recovered in %lld us\n", (alsa_now() - t) / 1000);
+
+	return rc;
 }
 
-int alsa_init(void)
+/*
+ * Open the PCM named by arg, or by settings.alsadev (-D)
+ */
+static int alsa_init(const char *arg)
 {
+	const char *dev;
 	int rc;
 
-	queue_init(&pq);
+	dev = arg[0] ? arg : settings.alsadev;
 
-	rc = alsa_setup();
+	rc = alsa_setup(dev);
 	if (rc < 0) {
-		fprintf(stderr, "unable to setup alsa: %s\n", snd_strerror(rc));
+		fprintf(stderr, "unable to setup alsa %s: %s\n", dev, snd_strerror(rc));
 		return -1;
 	}
 
@@ -381,60 +517,184 @@ int alsa_init(void)
 		fprintf(stderr, "unable to start alsa: %s\n", snd_strerror(rc));
 		return -1;
 	}
+
+	n_pfds = snd_pcm_poll_descriptors_count(pdev);
+	if ((n_pfds <= 0) || (n_pfds > MAX_POLL_FDS) ||
+	    (snd_pcm_poll_descriptors(pdev, pfds, n_pfds) != n_pfds)) {
+		fprintf(stderr, "unable to get alsa poll descriptors\n");
+		alsa_stop();
+		alsa_close();
+		return -1;
+	}
 	return 0;
 }
 
-void alsa_fini(void)
+static void alsa_fini(void)
 {
 	alsa_stop();
 	alsa_close();
-	queue_destroy(&pq);
 }
 
-void *alsa_task(void *cookie)
+/*
+ * Copy one rendered period directly into the hardware buffer.
+ * The buffer may wrap, so it can take more than one pass.
+ * Returns 0, ALSA_STOPPING or an ALSA error code.
+ */
+static int alsa_mmap_period(void)
 {
-	usleep(THREAD_STARTUP_DELAY_US);
+	const snd_pcm_channel_area_t *areas;
+	snd_pcm_uframes_t offset;
+	snd_pcm_uframes_t frames;
+	snd_pcm_sframes_t rc;
+	unsigned char *buf;
+	int remain;
+
+	PROF_START(t_write);
+
+	rc = snd_pcm_avail_update(pdev);
+	SND_IO(snd_pcm_avail_update, rc, SND_IGN_VAL);
+
+	remain = FRAMES_PER_PERIOD;
+	while ((rc >= 0) && remain) {
+		frames = remain;
+		rc = snd_pcm_mmap_begin(pdev, &areas, &offset, &frames);
+		SND_IO(snd_pcm_mmap_begin, rc, remain);
+		if (rc < 0)
+			break;
+		if (frames == 0) {
+			/* not enough room yet */
+			rc = alsa_wait(SND_PCM_TIMEOUT_MS);
+			if (rc == ALSA_STOPPING)
+				return ALSA_STOPPING;
+			if (rc < 0)
+				break;
+			continue;
+		}
 
-	while (run_flag) {
-		int xrun;
-		int rc;
+		/* interleaved: every channel shares the first area */
+		buf = (unsigned char *)areas[0].addr +
+			(areas[0].first + offset * areas[0].step) / 8;
+		audio_read(buf, frames * FRAME_SIZE);
+
+		rc = snd_pcm_mmap_commit(pdev, offset, frames);
+		SND_IO(snd_pcm_mmap_commit, rc, frames);
+		if (rc < 0)
+			break;
+		if (rc != frames) {
+			rc = -EPIPE;
+			break;
+		}
+		remain -= frames;
+	}
+	if (rc >= 0)
+		alsa_stamp();
 
-		pthread_mutex_lock(&play_lock);
-		rc = snd_pcm_wait(pdev, SND_PCM_TIMEOUT_MS);
-		pthread_mutex_unlock(&play_lock);
-		SND_IO(snd_pcm_wait-p, rc, SND_PCM_TIMEOUT_MS);
-		if (rc == 0)
-			DPRINTF("snd_pcm_wait(playback): timeout\n");
+	if ((rc >= 0) && (snd_pcm_state(pdev) == SND_PCM_STATE_PREPARED)) {
+		rc = snd_pcm_start(pdev);
+		SND_IO(snd_pcm_start, rc, SND_IGN_VAL);
+	}
+	PROF_STOP(PROF_PCM_WRITE, t_write);
 
-		LOCK(pq);
+	return (rc < 0) ? rc : 0;
+}
 
-		if (pq.len == 0) {
-			get_period(pq.head, PERIOD_SIZE);
-			QINCP(pq, tail);
-			QINCLEN(pq);
-		}
+/*
+ * Write a whole period, resuming after a short write and
+ * rewriting whatever an xrun kept from being written.
+ */
+static int alsa_write(const unsigned char *buf)
+{
+	int remain = FRAMES_PER_PERIOD;
+	int rc;
 
-		xrun = 0;
-		pthread_mutex_lock(&play_lock);
-		rc = snd_pcm_writei(pdev, pq.head, FRAMES_PER_PERIOD);
-		pthread_mutex_unlock(&play_lock);
-		SND_IO(snd_pcm_writei, rc, FRAMES_PER_PERIOD);
-		if (rc == -EPIPE) {
-			xrun = XRUN_UNDERRUN;
-			pq.qs.xrun_cnt++;
-			alsa_xrun_recovery();
+	while (remain) {
+		PROF_START(t_write);
+		rc = snd_pcm_writei(pdev, buf, remain);
+		PROF_STOP(PROF_PCM_WRITE, t_write);
+		if (rc >= 0)
+			alsa_stamp();
+		SND_IO(snd_pcm_writei, rc, remain);
+
+		if (rc == -EAGAIN) {
+			rc = alsa_wait(SND_PCM_TIMEOUT_MS);
+			if (rc == ALSA_STOPPING)
+				return 0;
+			continue;
 		}
-
-		/* dequeue period */
-		if (pq.len) {
-			QINCP(pq, head);
-			QDECLEN(pq);
+		if (rc < 0) {
+			rc = alsa_recover(rc);
+			if (rc == ALSA_STOPPING)
+				return 0;
+			if (rc < 0)
+				return rc;
+			continue;
 		}
+		buf += rc * FRAME_SIZE;
+		remain -= rc;
+	}
+	return 0;
+}
 
-		UNLOCK(pq);
+static int alsa_play(void)
+{
+	unsigned char *buf;
+	int rc;
 
-		if (xrun)
-			DPRINTF("alsa_task: xrun\n");
+	rc = alsa_wait(SND_PCM_TIMEOUT_MS);
+	if (rc == ALSA_STOPPING)
+		return 0;
+	if (rc == 0)
+		RT_DPRINTF("alsa_wait(playback): timeout\n");
+	if (rc < 0) {
+		/* caught by poll, before a period was taken */
+		rc = alsa_recover(rc);
+		if (rc < 0)
+			return rc;
+		if (rc == ALSA_STOPPING)
+			return 0;
 	}
-	return NULL;
+
+	if (mmap_mode) {
+		/*
+		 * The copy into the DMA buffer is what an xrun loses
+		 * here, and only if it strikes between mmap_begin and
+		 * mmap_commit; otherwise nothing has been taken yet.
+		 */
+		rc = alsa_mmap_period();
+		if (rc == ALSA_STOPPING)
+			return 0;
+		if ((rc == -EPIPE) || (rc == -ESTRPIPE))
+			rc = alsa_recover(rc);
+		return (rc < 0) ? rc : 0;
+	}
+
+	buf = audio_period();
+	rc = alsa_write(buf);
+	audio_period_done(buf);
+
+	return rc;
+}
+
+/*
+ * Only silence is left in the buffer, so drop it rather than
+ * drain; resume leaves the PCM prepared to start on the next
+ * period.
+ */
+static void alsa_pause(void)
+{
+	alsa_stop();
 }
+
+static void alsa_resume(void)
+{
+	alsa_start();
+}
+
+const struct audio_backend alsa_backend = {
+	.name = "alsa",
+	.open = alsa_init,
+	.close = alsa_fini,
+	.play = alsa_play,
+	.pause = alsa_pause,
+	.resume = alsa_resume,
+};
@@ -15,12 +15,19 @@
 #ifndef _ALSA_H_
 #define _ALSA_H_
 
-#define SAMPLE_RATE		48000
+#include "pcm.h"
+
+/*
+ * The rate, channels and format are negotiated when the sink
+ * is opened and kept in settings; the sizes below are in the
+ * sink's format.
+ */
 #define SND_PCM_TIMEOUT_MS	30
-#define FORMAT			SND_PCM_FORMAT_S16_LE
-#define CHANNELS		2
-#define SAMPLE_SIZE		((int)sizeof(short))
-#define FRAME_SIZE		(SAMPLE_SIZE * CHANNELS)
+#define MAX_CHANNELS		8
+#define SAMPLE_SIZE		pcm_sample_size(settings.format)
+#define FRAME_SIZE		(SAMPLE_SIZE * settings.n_chans)
+#define MAX_SAMPLE_SIZE		4
+#define MAX_FRAME_SIZE		(MAX_SAMPLE_SIZE * MAX_CHANNELS)
 #define FRAMES_PER_PERIOD	(6 * 160)
 #define PERIODS_PER_BUFFER	2
 #define FRAMES_PER_BUFFER	(FRAMES_PER_PERIOD * PERIODS_PER_BUFFER)
@@ -29,8 +36,4 @@
 
 #define US_TO_HZ(_t)		(1.0e6 / (float)(_t))
 
-extern int alsa_init(void);
-extern void alsa_fini(void);
-extern void *alsa_task(void *cookie);
-
 #endif
@@ -0,0 +1,667 @@
+/*
+ * Copyright (C) 2018 by Ross Wille. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * COPYING file for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+
+#include "config.h"
+#include "alsa.h"
+#include "sym-queue.h"
+#include "threads.h"
+#include "ring.h"
+#include "reactor.h"
+#include "latency.h"
+#include "prof.h"
+#include "rt.h"
+#include "rtlog.h"
+#include "audio.h"
+
+#define NS_PER_SEC		1000000000LL
+
+/*
+ * Adaptive render-ahead: the depth is checked once per interval
+ * and grows at once on trouble, but only shrinks after a run of
+ * quiet intervals in which the ring never ran low.
+ */
+#define ADAPT_INTERVAL_MS	1000
+#define ADAPT_CALM_INTERVALS	10
+
+/*
+ * Idle: once nothing but silence has been rendered for this
+ * long, the audio thread pauses the output and sleeps until
+ * the next symbol is queued.
+ */
+#define IDLE_DELAY_MS		200
+
+#ifdef QUEUE_STATS
+#define QSTAT_HIST(_l)		qs.level_cnts[_l]++
+#define QSTAT_UNDERRUN()	qs.underrun_cnt++
+#define QSTAT_XRUN()		qs.xrun_cnt++
+#define QSTAT_GROW()		qs.grow_cnt++
+#define QSTAT_SHRINK()		qs.shrink_cnt++
+#else
+#define QSTAT_HIST(_l)		do {} while (0)
+#define QSTAT_UNDERRUN()	do {} while (0)
+#define QSTAT_XRUN()		do {} while (0)
+#define QSTAT_GROW()		do {} while (0)
+#define QSTAT_SHRINK()		do {} while (0)
+#endif
+
+#ifdef QUEUE_STATS
+/*
+ * Only the audio thread updates these.
+ */
+struct queue_stats {
+	unsigned int level_cnts[RING_SLOTS + 1];
+	unsigned int underrun_cnt;
+	unsigned int xrun_cnt;
+	unsigned int grow_cnt;		/* by the render thread */
+	unsigned int shrink_cnt;	/* by the render thread */
+};
+
+static struct queue_stats qs;
+
+static long long deadline;		/* audio thread: next period due */
+
+/*
+ * Stdout may be the PCM stream (-o stdout), so report on stderr
+ */
+static void print_qstats(struct queue_stats *qs)
+{
+	FILE *fp = stderr;
+	int i;
+
+	fprintf(fp, "  queue-level histogram:\r\n");
+	for (i = 0; i <= RING_SLOTS; i++) {
+		if ((i > settings.ahead) && (qs->level_cnts[i] == 0))
+			continue;
+		fprintf(fp, "       level%d: %d\r\n", i, qs->level_cnts[i]);
+	}
+	fprintf(fp, "    underruns: %d\r\n", qs->underrun_cnt);
+	fprintf(fp, "      hw_xrun: %d\r\n", qs->xrun_cnt);
+	fprintf(fp, "  ahead grown: %d\r\n", qs->grow_cnt);
+	fprintf(fp, " ahead shrunk: %d\r\n", qs->shrink_cnt);
+	prof_print(fp);
+	fprintf(fp, "\r\n");
+}
+#endif
+
+static const struct audio_backend *backends[] = {
+	&alsa_backend,
+	&null_backend,
+	&wav_backend,
+	&stdout_backend,
+};
+
+static const struct audio_backend *backend;
+
+static struct ring_struct ring;		/* rendered periods, in the sink's format */
+static float *mix;			/* render thread: a period before conversion */
+static struct pcm_dither dither;	/* render thread */
+static unsigned char *silence;		/* played on underrun */
+static int read_offset;			/* bytes of the head slot used */
+static int stop_fd = -1;		/* eventfd: the session is ending */
+static int done_fd = -1;		/* eventfd: the output has stopped */
+static int wake_fd = -1;		/* eventfd: the ring is refilled after idle */
+
+/*
+ * Set by the render thread when it stops rendering silence and
+ * cleared by audio_resume().  The audio thread sleeps once it
+ * has played out the ring.
+ */
+static atomic_int idle;
+static int idle_periods;		/* 0 if the sink cannot pause */
+
+struct wakeup_struct {
+	long long start_ns;
+	unsigned long audio;		/* audio thread */
+	unsigned long render;		/* render thread */
+	long long idle_ns;		/* audio thread paused */
+};
+
+static struct wakeup_struct wakeups;
+
+struct render_struct {
+	int quiet;			/* silent periods in a row */
+	int paused;
+};
+
+static struct render_struct render;	/* render thread only */
+
+/*
+ * Written by the audio thread, read by the render thread
+ */
+static atomic_uint underruns;
+static atomic_uint xruns;
+static atomic_llong jitter_max;		/* ns, this interval */
+static atomic_int level_min;		/* this interval */
+
+static long long last_wake;		/* audio thread only */
+static long long period_ns;
+
+static long long out_frames;		/* audio thread: frames given to the sink */
+static int stamped;			/* audio thread: sink timed this period */
+
+struct adapt_struct {
+	long long next_ns;
+	unsigned int underruns;
+	unsigned int xruns;
+	int calm;
+};
+
+static struct adapt_struct adapt;	/* render thread only */
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+static void audio_close_fds(void)
+{
+	if (stop_fd >= 0)
+		close(stop_fd);
+	if (done_fd >= 0)
+		close(done_fd);
+	if (wake_fd >= 0)
+		close(wake_fd);
+	stop_fd = done_fd = wake_fd = -1;
+}
+
+static void audio_signal(int fd)
+{
+	uint64_t one = 1;
+
+	if (write(fd, &one, sizeof(one)) < 0)
+		perror("audio_signal");
+}
+
+/*
+ * Open the sink named by "name[:arg]", e.g. "alsa:hw:1,0",
+ * "null:fast" or "wav:session.wav".
+ */
+int audio_init(const char *sink)
+{
+	const char *arg;
+	int len;
+	int i;
+
+	arg = strchr(sink, ':');
+	len = arg ? arg - sink : strlen(sink);
+	arg = arg ? arg + 1 : "";
+
+	for (i = 0; i < N_ARRAY(backends); i++) {
+		if ((strncmp(backends[i]->name, sink, len) == 0) &&
+		    (backends[i]->name[len] == '\0'))
+			break;
+	}
+	if (i == N_ARRAY(backends)) {
+		fprintf(stderr, "unknown audio output: %s\n", sink);
+		return -1;
+	}
+
+	/* the sink settles the rate, channels and format */
+	if (backends[i]->open(arg) < 0)
+		return -1;
+	backend = backends[i];
+
+	silence = calloc(1, PERIOD_SIZE);
+	mix = calloc(FRAMES_PER_PERIOD * settings.n_chans, sizeof(float));
+	if ((silence == NULL) || (mix == NULL) ||
+	    (ring_create(&ring, RING_SLOTS, PERIOD_SIZE, settings.ahead) < 0)) {
+		backend->close();
+		backend = NULL;
+		free(silence);
+		free(mix);
+		return -1;
+	}
+	rt_prefault(silence, PERIOD_SIZE);
+	rt_prefault(mix, FRAMES_PER_PERIOD * settings.n_chans * sizeof(float));
+	rt_prefault(ring.buf, RING_SLOTS * PERIOD_SIZE);
+	pcm_dither_init(&dither, 0);
+	read_offset = 0;
+	stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	done_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	period_ns = FRAMES_PER_PERIOD * NS_PER_SEC / (long long)settings.sample_rate;
+	atomic_init(&level_min, RING_SLOTS);
+	atomic_init(&jitter_max, 0);
+	last_wake = 0;
+	memset(&adapt, 0, sizeof(adapt));
+
+	out_frames = 0;
+	stamped = 0;
+	latency_init(settings.sample_rate);
+	atomic_init(&idle, 0);
+	memset(&render, 0, sizeof(render));
+	memset(&wakeups, 0, sizeof(wakeups));
+	wakeups.start_ns = now_ns();
+
+	if ((stop_fd < 0) || (done_fd < 0) || (wake_fd < 0)) {
+		backend->close();
+		backend = NULL;
+		audio_close_fds();
+		ring_destroy(&ring);
+		free(silence);
+		free(mix);
+		return -1;
+	}
+
+	idle_periods = 0;
+	if (settings.idle && backend->pause) {
+		idle_periods = (IDLE_DELAY_MS * 1000000LL + period_ns - 1) / period_ns;
+		if (idle_periods <= settings.ahead)
+			idle_periods = settings.ahead + 1;
+	}
+
+	return 0;
+}
+
+void audio_fini(void)
+{
+	if (backend) {
+		backend->close();
+		audio_close_fds();
+		ring_destroy(&ring);
+		free(silence);
+		free(mix);
+	}
+	backend = NULL;
+}
+
+/*
+ * End the session: wake the audio thread out of audio_poll()
+ * and the render thread out of its wait for ring space.  Clear
+ * run_flag first.
+ */
+void audio_stop(void)
+{
+	audio_signal(stop_fd);
+	ring_kick(&ring);
+}
+
+/*
+ * Main thread: a symbol has been queued.  Wake the render
+ * thread if it has gone idle; it refills the ring and then
+ * wakes the audio thread.
+ */
+void audio_resume(void)
+{
+	if (atomic_exchange(&idle, 0))
+		ring_kick(&ring);
+}
+
+/*
+ * Readable once the output has stopped for good, so that the
+ * main loop can quit instead of waiting on the keyboard.
+ */
+int audio_fd(void)
+{
+	return done_fd;
+}
+
+/*
+ * Audio thread: poll fds, plus the end of the session.
+ * Returns -1 once audio_stop() has been called, otherwise
+ * as poll(2).
+ */
+int audio_poll(struct pollfd *fds, int n_fds, int timeout_ms)
+{
+	struct pollfd pfds[n_fds + 1];
+	int rc;
+	int i;
+
+	memcpy(pfds, fds, n_fds * sizeof(*fds));
+	pfds[n_fds].fd = stop_fd;
+	pfds[n_fds].events = POLLIN;
+
+	do {
+		rc = poll(pfds, n_fds + 1, timeout_ms);
+	} while ((rc < 0) && (errno == EINTR));
+	wakeups.audio++;
+
+	if ((rc > 0) && pfds[n_fds].revents)
+		return -1;
+	for (i = 0; i < n_fds; i++)
+		fds[i].revents = pfds[i].revents;
+
+	return rc;
+}
+
+/*
+ * Render thread: move the render-ahead depth toward the lowest
+ * latency that stays free of underruns and xruns.
+ *
+ * Any underrun or xrun, or audio-thread wake-up jitter of more
+ * than the spare periods can cover, grows the depth at once.
+ * After ADAPT_CALM_INTERVALS quiet intervals in which the ring
+ * always held at least one spare period, it shrinks by one.
+ */
+static void audio_adapt(void)
+{
+	unsigned int u;
+	unsigned int x;
+	long long jitter;
+	long long t;
+	int lmin;
+	int depth;
+	int need;
+
+	t = now_ns();
+	if (t < adapt.next_ns)
+		return;
+	adapt.next_ns = t + ADAPT_INTERVAL_MS * 1000000LL;
+
+	u = atomic_load(&underruns);
+	x = atomic_load(&xruns);
+	jitter = atomic_exchange(&jitter_max, 0);
+	lmin = atomic_exchange(&level_min, RING_SLOTS);
+	depth = atomic_load(&ring.depth);
+
+	/* one period, plus enough spares to ride out the jitter */
+	need = 1 + jitter / period_ns;
+	if (need > RING_SLOTS)
+		need = RING_SLOTS;
+
+	if ((u != adapt.underruns) || (x != adapt.xruns) || (need > depth)) {
+		adapt.calm = 0;
+		if (depth < RING_SLOTS) {
+			depth = (need > depth + 1) ? need : depth + 1;
+			atomic_store(&ring.depth, depth);
+			QSTAT_GROW();
+			RT_DPRINTF("render-ahead: %d periods (underruns=%u xruns=%u jitter=%lld us)\n",
+				depth, u, x, jitter / 1000);
+		}
+	}
+	else if ((++adapt.calm >= ADAPT_CALM_INTERVALS) && (lmin >= 2) &&
+		 (need < depth)) {
+		adapt.calm = 0;
+		atomic_store(&ring.depth, --depth);
+		QSTAT_SHRINK();
+		RT_DPRINTF("render-ahead: %d periods\n", depth);
+	}
+	adapt.underruns = u;
+	adapt.xruns = x;
+}
+
+/*
+ * Audio thread: note the ring level and the wake-up jitter
+ * for each period taken.
+ */
+static void audio_wake(void)
+{
+	long long jitter;
+	long long t;
+	int level;
+
+	level = ring_level(&ring);
+	QSTAT_HIST(level);
+	if (level < atomic_load_explicit(&level_min, memory_order_relaxed))
+		atomic_store_explicit(&level_min, level, memory_order_relaxed);
+
+	t = now_ns();
+#ifdef QUEUE_STATS
+	{
+		long long late;
+
+		if (last_wake == 0)
+			deadline = t;
+		late = t - deadline;
+		prof_add(PROF_WAKE, deadline, (late < 0) ? -late : late);
+		/* follow the output's clock, which drifts against ours */
+		deadline += period_ns + late / 16;
+	}
+#endif
+	if (last_wake) {
+		jitter = t - last_wake - period_ns;
+		if (jitter < 0)
+			jitter = -jitter;
+		if (jitter > atomic_load_explicit(&jitter_max, memory_order_relaxed))
+			atomic_store_explicit(&jitter_max, jitter, memory_order_relaxed);
+	}
+	last_wake = t;
+}
+
+static int audio_slot(unsigned char *buf)
+{
+	return (buf - ring.buf) / ring.slot_size;
+}
+
+static void audio_fill(void)
+{
+	struct lat_slot *ls;
+	unsigned char *buf;
+
+	while ((buf = ring_write_slot(&ring)) != NULL) {
+		PROF_START(t_render);
+		ls = latency_slot(audio_slot(buf));
+		ls->n = get_period_marked(mix, FRAMES_PER_PERIOD, ls->marks, LAT_MARKS);
+		pcm_convert(buf, mix, FRAMES_PER_PERIOD * settings.n_chans, settings.format,
+			&dither);
+		PROF_STOP(PROF_GET_PERIOD, t_render);
+		ring_publish(&ring);
+		render.quiet = sq_busy() ? 0 : render.quiet + 1;
+	}
+}
+
+/*
+ * Render thread: keep the ring filled the render-ahead depth
+ * ahead of the audio thread, then sleep until it takes one.
+ * All synthesis and symbol-queue locking happens here.
+ *
+ * After idle_periods of silence it stops, leaving the audio
+ * thread to play out the ring and pause the output.
+ */
+void audio_render(void)
+{
+	wakeups.render++;
+
+	if (render.paused) {
+		if (atomic_load(&idle)) {
+			ring_wait_space(&ring, -1);
+			return;
+		}
+		render.paused = 0;
+		render.quiet = 0;
+		sq_drop_filler();
+		audio_fill();
+		audio_signal(wake_fd);
+	}
+
+	if (settings.adaptive)
+		audio_adapt();
+
+	audio_fill();
+
+	if (idle_periods && (render.quiet >= idle_periods)) {
+		/* a racing sq_put() either sees idle or is seen here */
+		atomic_store(&idle, 1);
+		if (sq_busy())
+			atomic_store(&idle, 0);
+		else
+			render.paused = 1;
+	}
+	if (run_flag)
+		ring_wait_space(&ring, -1);
+}
+
+/*
+ * Audio thread: the ring is played out and the render thread
+ * is idle.  Pause the output until audio_resume().
+ */
+static void audio_sleep(void)
+{
+	struct pollfd pfd;
+	long long t;
+
+	/* a stale wake-up from an idle spell that never slept */
+	reactor_drain(wake_fd);
+	if (!atomic_load(&idle))
+		return;
+
+	t = now_ns();
+	backend->pause();
+
+	pfd.fd = wake_fd;
+	pfd.events = POLLIN;
+	if (audio_poll(&pfd, 1, -1) > 0)
+		reactor_drain(wake_fd);
+
+	backend->resume();
+	last_wake = 0;
+	wakeups.idle_ns += now_ns() - t;
+}
+
+/*
+ * Audio thread: the next rendered period, or silence if the
+ * render thread has fallen behind.  Never blocks.
+ */
+unsigned char *audio_period(void)
+{
+	unsigned char *buf;
+
+	audio_wake();
+	stamped = 0;
+	buf = ring_read_slot(&ring);
+	if (buf == NULL) {
+		QSTAT_UNDERRUN();
+		atomic_fetch_add(&underruns, 1);
+		buf = silence;
+	}
+	else {
+		latency_start(audio_slot(buf), out_frames);
+	}
+	out_frames += FRAMES_PER_PERIOD;
+
+	return buf;
+}
+
+/*
+ * Audio thread: a sink that knows its own delay reports it
+ * here once it has taken a period: at ts_ns, delay frames
+ * were still queued ahead of the DAC.
+ */
+void audio_timestamp(long long ts_ns, long delay)
+{
+	latency_played(out_frames, delay, ts_ns);
+	stamped = 1;
+}
+
+void audio_period_done(unsigned char *buf)
+{
+	/* otherwise the period starts playing now */
+	if (!stamped)
+		audio_timestamp(now_ns(), FRAMES_PER_PERIOD);
+	if (buf != silence)
+		ring_release(&ring);
+}
+
+/*
+ * Audio thread: copy len bytes of rendered audio, which need
+ * not be a whole period.
+ */
+void audio_read(unsigned char *buf, int len)
+{
+	unsigned char *slot;
+	int n;
+
+	while (len) {
+		if (read_offset == 0)
+			audio_wake();
+		slot = ring_read_slot(&ring);
+		if (slot == NULL) {
+			QSTAT_UNDERRUN();
+			atomic_fetch_add(&underruns, 1);
+			memset(buf, 0, len);
+			out_frames += len / FRAME_SIZE;
+			return;
+		}
+		if (read_offset == 0)
+			latency_start(audio_slot(slot), out_frames);
+		n = ring.slot_size - read_offset;
+		if (n > len)
+			n = len;
+		memcpy(buf, slot + read_offset, n);
+		buf += n;
+		len -= n;
+		read_offset += n;
+		out_frames += n / FRAME_SIZE;
+		if (read_offset == ring.slot_size) {
+			ring_release(&ring);
+			read_offset = 0;
+		}
+	}
+}
+
+/*
+ * Periods rendered ahead of the audio thread
+ */
+int audio_level(void)
+{
+	return ring_level(&ring);
+}
+
+void audio_xrun(void)
+{
+	QSTAT_XRUN();
+	atomic_fetch_add(&xruns, 1);
+}
+
+void *audio_task(void *cookie)
+{
+	rt_prefault_stack();
+	usleep(THREAD_STARTUP_DELAY_US);
+
+	while (run_flag) {
+		if (atomic_load(&idle) && (ring_level(&ring) == 0)) {
+			audio_sleep();
+			continue;
+		}
+		if (backend->play() < 0) {
+			rtlog("%s: output stopped\n", backend->name);
+			audio_signal(done_fd);
+			break;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Wake-ups per second of the audio and render threads, and of
+ * the main thread from its own count
+ */
+void audio_report(unsigned long main_wakeups)
+{
+	double secs;
+
+#ifdef QUEUE_STATS
+	print_qstats(&qs);
+#endif
+	secs = (now_ns() - wakeups.start_ns) / (double)NS_PER_SEC;
+	if (secs <= 0.0)
+		return;
+	fprintf(stderr, "wakeups/s: audio %0.1f, render %0.1f, main %0.1f; idle %0.0f%%\r\n",
+		wakeups.audio / secs, wakeups.render / secs, main_wakeups / secs,
+		100.0 * wakeups.idle_ns / NS_PER_SEC / secs);
+}
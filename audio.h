@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2018 by Ross Wille. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * COPYING file for more details.
+ */
+
+#ifndef _AUDIO_H_
+#define _AUDIO_H_
+
+/*
+ * Render-ahead ring between the render thread and the audio thread
+ */
+#define RING_SLOTS		16	/* power of two */
+#define DEFAULT_AHEAD		2	/* periods */
+
+struct pollfd;
+
+/*
+ * An audio sink.  play() takes one rendered period from the
+ * ring and hands it to the output, blocking as needed to keep
+ * pace.  It should block only in audio_poll(), which returns
+ * early when the session ends.  A negative return stops the
+ * audio thread.
+ *
+ * pause() and resume() are optional: a sink that has them is
+ * stopped while the trainer waits for input (-i), rather than
+ * fed silence.
+ */
+struct audio_backend {
+	const char *name;
+	int (*open)(const char *arg);
+	void (*close)(void);
+	int (*play)(void);
+	void (*pause)(void);
+	void (*resume)(void);
+};
+
+extern const struct audio_backend alsa_backend;
+extern const struct audio_backend null_backend;
+extern const struct audio_backend wav_backend;
+extern const struct audio_backend stdout_backend;
+
+extern int audio_init(const char *sink);
+extern void audio_fini(void);
+extern void audio_stop(void);
+extern void audio_resume(void);
+extern void audio_report(unsigned long main_wakeups);
+extern int audio_fd(void);
+extern int audio_poll(struct pollfd *fds, int n_fds, int timeout_ms);
+extern void *audio_task(void *cookie);
+extern void audio_render(void);
+extern unsigned char *audio_period(void);
+extern void audio_period_done(unsigned char *buf);
+extern void audio_timestamp(long long ts_ns, long delay);
+extern void audio_read(unsigned char *buf, int len);
+extern void audio_xrun(void);
+extern int audio_level(void);
+
+#endif
@@ -0,0 +1,559 @@
+/*
+ * Copyright (C) 2018 by Ross Wille. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * COPYING file for more details.
+ */
+
+/*
+ * Batch corpus generator.
+ *
+ * Each line of the manifest describes one WAV file:
+ *
+ *   FILE  WPM  TONE  RISE_MS  SEED  random:COUNT
+ *   FILE  WPM  TONE  RISE_MS  SEED  text:TEXT TO SEND
+ *   FILE  WPM  TONE  RISE_MS  SEED  words:COUNT
+ *
+ * words: draws from the --dict dictionary, which every worker
+ * reads from the one shared mapping.
+ * Blank lines and lines starting with '#' are ignored.  Volume,
+ * envelope, pan, sample rate, channels and format come from the
+ * command line.  The jobs run on a work-stealing pool with one thread per
+ * core, and all jobs with the same keying share one read-only
+ * symbol bank that is rendered the first time it is needed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "config.h"
+#include "alsa.h"
+#include "dict.h"
+#include "morse.h"
+#include "symbols.h"
+#include "synth.h"
+#include "batch.h"
+#include "wav.h"
+
+#define CHUNK_FRAMES		4096
+#define MAX_LINE		4096
+
+#define BANK_BUILDING		0
+#define BANK_READY		1
+#define BANK_FAILED		2
+
+/*
+ * A worker's buffers: a chunk of float frames, and the same
+ * converted to the output format
+ */
+struct mix_struct {
+	float *frames;
+	unsigned char *out;
+	struct pcm_dither dither;
+};
+
+struct job_struct {
+	char *fn;
+	struct keying_struct key;
+	long seed;
+	int count;		/* random characters or words, or 0 for text */
+	int words;		/* count is of dictionary entries */
+	char *text;
+	double bytes;		/* written */
+	int rc;
+};
+
+struct bank_entry {
+	struct keying_struct key;
+	struct symbol_bank bank;
+	int state;
+	struct bank_entry *next;
+};
+
+/*
+ * Each worker owns a deque of job numbers.  The owner pops from
+ * the bottom; idle workers steal from the top of the others.
+ */
+struct deque_struct {
+	pthread_mutex_t lock;
+	int *jobs;
+	int top;
+	int bottom;
+};
+
+static struct job_struct *jobs;
+static int n_jobs;
+
+static struct deque_struct *deques;
+static int n_workers;
+
+static struct bank_entry *banks;
+static int n_banks;
+static pthread_mutex_t bank_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t bank_ready = PTHREAD_COND_INITIALIZER;
+
+static float gain[MAX_CHANNELS];
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1.0e9;
+}
+
+static int keying_cmp(const struct keying_struct *a, const struct keying_struct *b)
+{
+	if (a->wpm != b->wpm)
+		return (a->wpm < b->wpm) ? -1 : 1;
+	if (a->tone != b->tone)
+		return (a->tone < b->tone) ? -1 : 1;
+	if (a->rise_ms != b->rise_ms)
+		return (a->rise_ms < b->rise_ms) ? -1 : 1;
+	if (a->volume != b->volume)
+		return (a->volume < b->volume) ? -1 : 1;
+	if (a->sample_rate != b->sample_rate)
+		return (a->sample_rate < b->sample_rate) ? -1 : 1;
+	return a->envelope - b->envelope;
+}
+
+static int job_cmp(const void *a, const void *b)
+{
+	return keying_cmp(&jobs[*(const int *)a].key, &jobs[*(const int *)b].key);
+}
+
+/*
+ * Find the bank for a keying, rendering it if this is the first
+ * job to ask.  Other jobs that want it meanwhile wait.
+ */
+static struct symbol_bank *get_bank(const struct keying_struct *kp)
+{
+	struct bank_entry *bp;
+	int rc;
+
+	pthread_mutex_lock(&bank_lock);
+
+	for (bp = banks; bp; bp = bp->next) {
+		if (keying_cmp(&bp->key, kp) == 0)
+			break;
+	}
+	if (bp) {
+		while (bp->state == BANK_BUILDING)
+			pthread_cond_wait(&bank_ready, &bank_lock);
+		pthread_mutex_unlock(&bank_lock);
+		return (bp->state == BANK_READY) ? &bp->bank : NULL;
+	}
+
+	bp = calloc(1, sizeof(*bp));
+	if (bp == NULL) {
+		pthread_mutex_unlock(&bank_lock);
+		return NULL;
+	}
+	bp->key = *kp;
+	bp->state = BANK_BUILDING;
+	bp->next = banks;
+	banks = bp;
+	n_banks++;
+
+	pthread_mutex_unlock(&bank_lock);
+
+	rc = bank_create(&bp->bank, kp);
+
+	pthread_mutex_lock(&bank_lock);
+	bp->state = rc ? BANK_FAILED : BANK_READY;
+	pthread_cond_broadcast(&bank_ready);
+	pthread_mutex_unlock(&bank_lock);
+
+	return rc ? NULL : &bp->bank;
+}
+
+static void free_banks(void)
+{
+	struct bank_entry *bp;
+
+	while (banks) {
+		bp = banks;
+		banks = bp->next;
+		bank_destroy(&bp->bank);
+		free(bp);
+	}
+}
+
+static int emit(struct wav_struct *wp, struct mix_struct *mp, const struct symbol_struct *sp)
+{
+	int n;
+	int i;
+
+	for (i = 0; i < sp->samples; i += n) {
+		n = sp->samples - i;
+		if (n > CHUNK_FRAMES)
+			n = CHUNK_FRAMES;
+		synth_fanout(mp->frames, sp->pcm + i, n, settings.n_chans, gain);
+		pcm_convert(mp->out, mp->frames, n * settings.n_chans, settings.format,
+			&mp->dither);
+		if (wav_write(wp, mp->out, n) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+/*
+ * Letter gaps between characters and word spaces between words;
+ * prosigns are written <AR>
+ */
+static int emit_text(struct wav_struct *wp, struct mix_struct *mp,
+	const struct symbol_bank *bp, const char *p)
+{
+	int space;
+	int sym;
+	int rc;
+
+	rc = 0;
+	space = -1;		/* nothing sent yet */
+	while (*p && (rc == 0)) {
+		if (*p == ' ') {
+			if (space == 0)
+				space = 1;
+			p++;
+			continue;
+		}
+		sym = cw_next(&p);
+		if (sym < 0)
+			continue;
+		if (space >= 0)
+			rc = emit(wp, mp, space ? &bp->space : &bp->letter);
+		if (rc == 0)
+			rc = emit(wp, mp, &bp->chars[sym]);
+		space = 0;
+	}
+	return rc;
+}
+
+static int render_job(struct job_struct *jp, struct mix_struct *mp)
+{
+	struct symbol_bank *bp;
+	struct wav_struct wav;
+	unsigned short xsubi[3];
+	int sym;
+	int rc;
+	int i;
+
+	bp = get_bank(&jp->key);
+	if (bp == NULL)
+		return -1;
+
+	if (wav_create(&wav, jp->fn, jp->key.sample_rate, settings.n_chans, settings.format) < 0)
+		return -1;
+
+	/* the same file whichever worker renders it */
+	pcm_dither_init(&mp->dither, jp->seed);
+
+	rc = 0;
+	if (jp->count) {
+		/* same sequence as srand48(seed) */
+		xsubi[0] = 0x330e;
+		xsubi[1] = jp->seed;
+		xsubi[2] = jp->seed >> 16;
+		for (i = 0; (i < jp->count) && (rc == 0); i++) {
+			if (jp->words) {
+				sym = dict_chooser_r(&dictionary, xsubi);
+				rc = emit_text(&wav, mp, bp, dict_entry(&dictionary, sym));
+			}
+			else {
+				sym = symbol_chooser_r(xsubi);
+				rc = emit(&wav, mp, &bp->chars[sym]);
+			}
+			if (rc == 0)
+				rc = emit(&wav, mp, &bp->space);
+		}
+	}
+	else {
+		rc = emit_text(&wav, mp, bp, jp->text);
+		if (rc == 0)
+			rc = emit(&wav, mp, &bp->space);
+	}
+
+	jp->bytes = WAV_HDR_SIZE + (double)wav.bytes;
+	if (wav_close(&wav) < 0)
+		rc = -1;
+
+	return rc;
+}
+
+static int take_job(int self)
+{
+	struct deque_struct *dq;
+	int job = -1;
+	int i;
+
+	/* own work first */
+	dq = &deques[self];
+	pthread_mutex_lock(&dq->lock);
+	if (dq->bottom > dq->top)
+		job = dq->jobs[--dq->bottom];
+	pthread_mutex_unlock(&dq->lock);
+
+	/* then steal the oldest work of another worker */
+	for (i = 1; (job < 0) && (i < n_workers); i++) {
+		dq = &deques[(self + i) % n_workers];
+		pthread_mutex_lock(&dq->lock);
+		if (dq->bottom > dq->top)
+			job = dq->jobs[dq->top++];
+		pthread_mutex_unlock(&dq->lock);
+	}
+	return job;
+}
+
+static void *batch_worker(void *cookie)
+{
+	int self = (long)cookie;
+	struct mix_struct mix;
+	int job;
+
+	mix.frames = malloc(CHUNK_FRAMES * MAX_CHANNELS * sizeof(float));
+	mix.out = malloc(CHUNK_FRAMES * MAX_FRAME_SIZE);
+	if ((mix.frames == NULL) || (mix.out == NULL)) {
+		/* its jobs are stolen, or left failed */
+		fprintf(stderr, "worker %d: out of memory\n", self);
+		free(mix.frames);
+		free(mix.out);
+		return NULL;
+	}
+
+	while ((job = take_job(self)) >= 0) {
+		jobs[job].rc = render_job(&jobs[job], &mix);
+		if (jobs[job].rc)
+			fprintf(stderr, "%s: failed\n", jobs[job].fn);
+	}
+	free(mix.frames);
+	free(mix.out);
+
+	return NULL;
+}
+
+static int parse_job(struct job_struct *jp, char *line)
+{
+	char fn[MAX_LINE];
+	char *spec;
+	char *p;
+	int n;
+
+	memset(jp, 0, sizeof(*jp));
+	jp->rc = -1;		/* until it is rendered */
+	keying_from_settings(&jp->key);
+
+	n = 0;
+	if (sscanf(line, "%s %lf %lf %lf %ld %n", fn, &jp->key.wpm,
+		   &jp->key.tone, &jp->key.rise_ms, &jp->seed, &n) != 5)
+		return -1;
+	if ((n == 0) || (jp->key.wpm <= 0.0))
+		return -1;
+
+	spec = line + n;
+	p = strchr(spec, '\n');
+	if (p)
+		*p = '\0';
+
+	if (strncmp(spec, "random:", 7) == 0) {
+		jp->count = atoi(spec + 7);
+		if (jp->count <= 0)
+			return -1;
+	}
+	else if (strncmp(spec, "words:", 6) == 0) {
+		jp->count = atoi(spec + 6);
+		jp->words = 1;
+		if ((jp->count <= 0) || (dictionary.n == 0))
+			return -1;
+	}
+	else if (strncmp(spec, "text:", 5) == 0) {
+		jp->text = strdup(spec + 5);
+		if (jp->text == NULL)
+			return -1;
+	}
+	else
+		return -1;
+
+	jp->fn = strdup(fn);
+
+	return jp->fn ? 0 : -1;
+}
+
+static void free_jobs(void)
+{
+	int i;
+
+	for (i = 0; i < n_jobs; i++) {
+		free(jobs[i].fn);
+		free(jobs[i].text);
+	}
+	free(jobs);
+	jobs = NULL;
+	n_jobs = 0;
+}
+
+/*
+ * Returns the number of bad lines, or -1
+ */
+static int read_manifest(const char *manifest)
+{
+	struct job_struct *more;
+	char line[MAX_LINE];
+	FILE *fp;
+	int lineno;
+	int size;
+	int bad;
+	int rc;
+
+	fp = fopen(manifest, "r");
+	if (fp == NULL) {
+		fprintf(stderr, "cannot open %s\n", manifest);
+		return -1;
+	}
+
+	size = 0;
+	lineno = 0;
+	bad = 0;
+	rc = 0;
+	while (fgets(line, sizeof(line), fp)) {
+		lineno++;
+		if ((line[0] == '#') || (line[0] == '\n'))
+			continue;
+		if (n_jobs == size) {
+			size = size ? 2 * size : 256;
+			more = realloc(jobs, size * sizeof(*jobs));
+			if (more == NULL) {
+				fprintf(stderr, "no memory for %s\n", manifest);
+				rc = -1;
+				break;
+			}
+			jobs = more;
+		}
+		if (parse_job(&jobs[n_jobs], line) < 0) {
+			fprintf(stderr, "%s:%d: bad job\n", manifest, lineno);
+			free(jobs[n_jobs].fn);
+			free(jobs[n_jobs].text);
+			bad++;
+			continue;
+		}
+		n_jobs++;
+	}
+	fclose(fp);
+
+	return rc ? rc : bad;
+}
+
+int batch_run(const char *manifest, int n_threads)
+{
+	pthread_t *threads;
+	int *started;
+	int *order;
+	double bytes;
+	double t;
+	int failed;
+	int bad;
+	int per;
+	int i;
+
+	bad = read_manifest(manifest);
+	if (bad) {
+		if (bad > 0)
+			fprintf(stderr, "%s: %d bad job%s, nothing rendered\n", manifest, bad,
+				(bad > 1) ? "s" : "");
+		free_jobs();
+		return -1;
+	}
+	if (n_jobs == 0) {
+		fprintf(stderr, "%s: no jobs\n", manifest);
+		return 0;
+	}
+
+	synth_pan_gains(gain, settings.n_chans, settings.pan);
+	if (settings.format < 0)
+		settings.format = PCM_S16;
+
+	if (n_threads <= 0)
+		n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (n_threads > n_jobs)
+		n_threads = n_jobs;
+	n_workers = n_threads;
+
+	/*
+	 * Deal out runs of jobs with the same keying, so that each
+	 * worker mostly touches one bank.
+	 */
+	order = malloc(n_jobs * sizeof(int));
+	deques = calloc(n_workers, sizeof(*deques));
+	threads = calloc(n_workers, sizeof(*threads));
+	started = calloc(n_workers, sizeof(*started));
+	if (!order || !deques || !threads || !started) {
+		fprintf(stderr, "no memory for %d jobs\n", n_jobs);
+		free(started);
+		free(threads);
+		free(deques);
+		free(order);
+		free_jobs();
+		return -1;
+	}
+	for (i = 0; i < n_jobs; i++)
+		order[i] = i;
+	qsort(order, n_jobs, sizeof(int), job_cmp);
+
+	per = (n_jobs + n_workers - 1) / n_workers;
+	for (i = 0; i < n_workers; i++) {
+		pthread_mutex_init(&deques[i].lock, NULL);
+		deques[i].jobs = order;
+		deques[i].top = i * per;
+		deques[i].bottom = (i + 1) * per;
+		if (deques[i].bottom > n_jobs)
+			deques[i].bottom = n_jobs;
+	}
+
+	t = now();
+	for (i = 0; i < n_workers; i++) {
+		if (pthread_create(&threads[i], NULL, batch_worker, (void *)(long)i) == 0)
+			started[i] = 1;
+		else
+			batch_worker((void *)(long)i);
+	}
+	for (i = 0; i < n_workers; i++) {
+		if (started[i])
+			pthread_join(threads[i], NULL);
+	}
+	t = now() - t;
+
+	bytes = 0;
+	failed = 0;
+	for (i = 0; i < n_jobs; i++) {
+		if (jobs[i].rc)
+			failed++;
+		else
+			bytes += jobs[i].bytes;
+	}
+
+	fprintf(stderr, "%d files (%d failed), %d banks, %d threads in %0.3f s\n",
+		n_jobs, failed, n_banks, n_workers, t);
+	fprintf(stderr, "%0.1f files/s, %0.1f MB/s\n",
+		(n_jobs - failed) / t, bytes / 1.0e6 / t);
+
+	for (i = 0; i < n_workers; i++)
+		pthread_mutex_destroy(&deques[i].lock);
+	free(started);
+	free(threads);
+	free(deques);
+	free(order);
+	free_jobs();
+	free_banks();
+
+	return failed ? -1 : 0;
+}
@@ -15,6 +15,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <linux/limits.h>
 
 #include "config.h"
@@ -23,21 +24,29 @@
 #define CONFIG_FILE	".cw-trainer.conf"
 
 char config_path[PATH_MAX];
+unsigned int config_seq;
 
-static char *get_config_path(void)
+/*
+ * name in $HOME, or in the current directory without one
+ */
+void config_home_path(char *buf, int len, const char *name)
 {
 	char *home;
 
 	home = getenv("HOME");
 	if (home)
-		snprintf(config_path, sizeof(config_path), "%s/%s", home, CONFIG_FILE);
+		snprintf(buf, len, "%s/%s", home, name);
 	else
-		strcpy(config_path, CONFIG_FILE);
+		snprintf(buf, len, "%s", name);
+}
 
+static char *get_config_path(void)
+{
+	config_home_path(config_path, sizeof(config_path), CONFIG_FILE);
 	return config_path;
 }
 
-static void normalize_weights(void)
+static void normalize_weights(float *w)
 {
 	int i;
 	int n;
@@ -47,29 +56,34 @@ static void normalize_weights(void)
 	n = 0;
 	sum = 0.0;
 	for (i = 0; i < n_cw; i++) {
-		if (cw[i].weight < 0.0)
-			cw[i].weight = 0.0;
-		if (cw[i].weight != 0.0) {
-			sum += cw[i].weight;
+		if (w[i] < 0.0)
+			w[i] = 0.0;
+		if (w[i] != 0.0) {
+			sum += w[i];
 			n++;
 		}
 	}
 	if (n) {
 		scale = (float)n / sum;
 		for (i = 0; i < n_cw; i++) {
-			if (cw[i].weight != 0.0)
-				cw[i].weight *= scale;
+			if (w[i] != 0.0)
+				w[i] *= scale;
 		}
 	}
 	else {
 		for (i = 0; i < n_cw; i++) {
-			cw[i].weight = 1.0;
+			w[i] = 1.0;
 		}
 	}
 }
 
+/*
+ * The "journal" line holds the last journal record already
+ * counted in the weights; see journal.c.
+ */
 void config_read(void)
 {
+	float w[MAX_SYMBOLS];
 	FILE *fp;
 	char line[128];
 	int i;
@@ -87,37 +101,76 @@ void config_read(void)
 		if (!p)
 			continue;
 		*p++ = '\0';
-		for (i = 0; i < n_cw; i++) {
-			if (strcmp(cw[i].symbol, line) == 0) {
-				cw[i].weight = atof(p);
-				break;
-			}
+		if (strcmp(line, "journal") == 0) {
+			config_seq = strtoul(p, NULL, 10);
+			continue;
 		}
+		i = cw_find(line);
+		if (i >= 0)
+			cw[i].weight = atof(p);
 	}
 	fclose(fp);
 
-	normalize_weights();
+	for (i = 0; i < n_cw; i++)
+		w[i] = cw[i].weight;
+	normalize_weights(w);
+	for (i = 0; i < n_cw; i++)
+		cw[i].weight = w[i];
 }
 
-void config_write(void)
+/*
+ * Write the weights, normalized, and the journal position they
+ * include.  The file is replaced whole, so a crash leaves
+ * either the old one or the new one.
+ */
+int config_save(const float *weights, unsigned int seq)
 {
+	char tmp_path[PATH_MAX + 8];
+	float w[MAX_SYMBOLS];
 	FILE *fp;
+	int rc;
 	int i;
 
-	normalize_weights();
+	for (i = 0; i < n_cw; i++)
+		w[i] = weights[i];
+	normalize_weights(w);
 
-	fp = fopen(get_config_path(), "w");
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", get_config_path());
+	fp = fopen(tmp_path, "w");
 	if (fp == NULL) {
-		fprintf(stderr, "Cannot write config file %s\r\n", get_config_path());
-		return;
+		fprintf(stderr, "Cannot write config file %s\r\n", tmp_path);
+		return -1;
 	}
 
 	for (i = 0; i < n_cw; i++) {
-		if (cw[i].weight > 0.0)
-			fprintf(fp, "%-4s%0.5f\n", cw[i].symbol, cw[i].weight);
+		if (w[i] > 0.0)
+			fprintf(fp, "%-5s%0.5f\n", cw[i].symbol, w[i]);
 		else
-			fprintf(fp, "%-4s0\n", cw[i].symbol);
+			fprintf(fp, "%-5s0\n", cw[i].symbol);
 	}
-	fclose(fp);
+	if (seq)
+		fprintf(fp, "journal %u\n", seq);
+
+	rc = fflush(fp);
+	if (rc == 0)
+		rc = fsync(fileno(fp));
+	if (fclose(fp) != 0)
+		rc = -1;
+	if ((rc == 0) && (rename(tmp_path, config_path) < 0))
+		rc = -1;
+	if (rc < 0) {
+		fprintf(stderr, "Cannot write config file %s\r\n", config_path);
+		unlink(tmp_path);
+	}
+	return rc;
 }
 
+void config_write(void)
+{
+	float w[MAX_SYMBOLS];
+	int i;
+
+	for (i = 0; i < n_cw; i++)
+		w[i] = cw[i].weight;
+	config_save(w, config_seq);
+}
@@ -50,18 +50,32 @@
 
 struct settings_struct {
 	char alsadev[32];
+	char output[256];
 	double wpm;
 	double tone;
 	double volume;
 	double rise_ms;
+	int envelope;
 	double sample_rate;
 	int n_chans;
+	int format;		/* PCM_*, or -1 to negotiate */
+	int src_quality;	/* SRC_* */
+	double pan;
+	int mmap;
+	int ahead;
+	int adaptive;
+	int idle;
+	int cpu;		/* pin the audio thread, or -1 */
 };
 
 extern int run_flag;
 extern struct settings_struct settings;
 
+extern unsigned int config_seq;
+
+extern void config_home_path(char *buf, int len, const char *name);
 extern void config_read(void);
+extern int config_save(const float *weights, unsigned int seq);
 extern void config_write(void);
 
 #endif
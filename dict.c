@@ -0,0 +1,328 @@
+/*
+ * Copyright (C) 2018 by Ross Wille. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * COPYING file for more details.
+ */
+
+/*
+ * Word, phrase and callsign lists.
+ *
+ * A text list is compiled once into a flat file that is mapped
+ * at startup, so even a million entries cost no parsing and
+ * their pages are shared between processes.  The weights are
+ * stored as a running total, so a weighted draw is a binary
+ * search of the mapped array and needs no table at run time.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "dict.h"
+#include "morse.h"
+
+struct dict_struct dictionary;
+
+/*
+ * Upper case, runs of blanks folded to one space, prosigns as
+ * <AR>, and nothing that cannot be sent.  Returns the length,
+ * or -1.
+ */
+static int dict_normalize(char *out, const char *in)
+{
+	const char *name;
+	int len = 0;
+	int sym;
+	int n;
+
+	while (*in) {
+		if (isspace((unsigned char)*in)) {
+			if (len && (out[len - 1] != ' '))
+				out[len++] = ' ';
+			in++;
+			continue;
+		}
+		sym = cw_next(&in);
+		if (sym < 0)
+			return -1;
+		name = cw[sym].symbol;
+		n = strlen(name);
+		if (len + n > DICT_MAX_LEN)
+			return -1;
+		memcpy(out + len, name, n);
+		len += n;
+	}
+	if (len && (out[len - 1] == ' '))
+		len--;
+	out[len] = '\0';
+
+	return len ? len : -1;
+}
+
+static int grow(void **p, size_t *cap, size_t need, size_t size)
+{
+	void *np;
+	size_t n;
+
+	if (need <= *cap)
+		return 0;
+	n = *cap ? *cap : 1024;
+	while (n < need)
+		n *= 2;
+	np = realloc(*p, n * size);
+	if (np == NULL)
+		return -1;
+	*p = np;
+	*cap = n;
+	return 0;
+}
+
+/*
+ * Compile a text list into fn.  One entry per line, optionally
+ * followed by a tab and its weight (default 1); blank lines and
+ * lines starting with '#' are skipped.  The file is written
+ * beside fn and renamed, so a running trainer never sees half
+ * of it.
+ */
+int dict_compile(const char *text_fn, const char *fn)
+{
+	struct dict_header hdr;
+	char text[DICT_MAX_LEN + 1];
+	char tmp_fn[4096];
+	char *line = NULL;
+	size_t line_cap = 0;
+	double *cum = NULL;
+	uint32_t *off = NULL;
+	char *pool = NULL;
+	size_t cum_cap = 0;
+	size_t off_cap = 0;
+	size_t pool_cap = 0;
+	size_t pool_len = 0;
+	size_t n = 0;
+	int max_len = 0;
+	double total = 0.0;
+	double weight;
+	FILE *in;
+	FILE *out;
+	char *tab;
+	int skipped = 0;
+	int len;
+	int rc = -1;
+
+	in = fopen(text_fn, "r");
+	if (in == NULL) {
+		perror(text_fn);
+		return -1;
+	}
+
+	while (getline(&line, &line_cap, in) >= 0) {
+		line[strcspn(line, "\r\n")] = '\0';
+		if ((line[0] == '#') || (line[strspn(line, " \t")] == '\0'))
+			continue;
+
+		weight = 1.0;
+		tab = strchr(line, '\t');
+		if (tab) {
+			*tab++ = '\0';
+			weight = atof(tab);
+		}
+		len = dict_normalize(text, line);
+		if ((len < 0) || (weight < 0.0)) {
+			skipped++;
+			continue;
+		}
+
+		if ((n >= UINT32_MAX) ||
+		    (grow((void **)&cum, &cum_cap, n + 1, sizeof(*cum)) < 0) ||
+		    (grow((void **)&off, &off_cap, n + 1, sizeof(*off)) < 0) ||
+		    (grow((void **)&pool, &pool_cap, pool_len + len + 1, 1) < 0) ||
+		    (pool_len + len + 1 > UINT32_MAX)) {
+			fprintf(stderr, "%s: too many entries\n", text_fn);
+			goto done;
+		}
+		total += weight;
+		cum[n] = total;
+		off[n] = pool_len;
+		memcpy(pool + pool_len, text, len + 1);
+		pool_len += len + 1;
+		if (len > max_len)
+			max_len = len;
+		n++;
+	}
+	if (n == 0) {
+		fprintf(stderr, "%s: no entries\n", text_fn);
+		goto done;
+	}
+
+	memcpy(hdr.magic, DICT_MAGIC, sizeof(hdr.magic));
+	hdr.version = DICT_VERSION;
+	hdr.n = n;
+	hdr.pool_len = pool_len;
+	hdr.max_len = max_len;
+	hdr.reserved = 0;
+
+	snprintf(tmp_fn, sizeof(tmp_fn), "%s.tmp", fn);
+	out = fopen(tmp_fn, "w");
+	if (out == NULL) {
+		perror(tmp_fn);
+		goto done;
+	}
+	if ((fwrite(&hdr, sizeof(hdr), 1, out) != 1) ||
+	    (fwrite(cum, sizeof(*cum), n, out) != n) ||
+	    (fwrite(off, sizeof(*off), n, out) != n) ||
+	    (fwrite(pool, 1, pool_len, out) != pool_len) ||
+	    (fclose(out) != 0)) {
+		perror(tmp_fn);
+		unlink(tmp_fn);
+		goto done;
+	}
+	if (rename(tmp_fn, fn) < 0) {
+		perror(fn);
+		unlink(tmp_fn);
+		goto done;
+	}
+
+	printf("%s: %zu entries", fn, n);
+	if (skipped)
+		printf(", %d skipped (too long, not sendable or negative weight)", skipped);
+	printf("\n");
+	rc = 0;
+
+done:
+	fclose(in);
+	free(line);
+	free(cum);
+	free(off);
+	free(pool);
+	return rc;
+}
+
+/*
+ * Only the header is checked, so opening takes the same time
+ * for any size; dict_entry() checks each offset as it is used.
+ */
+static int dict_parse(struct dict_struct *dp)
+{
+	const struct dict_header *hp = dp->map;
+	const char *p = dp->map;
+
+	if (dp->map_len < sizeof(*hp))
+		return -1;
+	if ((memcmp(hp->magic, DICT_MAGIC, sizeof(hp->magic)) != 0) ||
+	    (hp->version != DICT_VERSION) || (hp->n == 0) || (hp->n > INT32_MAX) ||
+	    (hp->pool_len == 0) || (hp->max_len == 0) || (hp->max_len > DICT_MAX_LEN))
+		return -1;
+	if (dp->map_len != sizeof(*hp) + (size_t)hp->n * (sizeof(double) + sizeof(uint32_t)) +
+	    hp->pool_len)
+		return -1;
+
+	dp->n = hp->n;
+	dp->pool_len = hp->pool_len;
+	dp->max_len = hp->max_len;
+	dp->cum = (const double *)(p + sizeof(*hp));
+	dp->off = (const uint32_t *)(dp->cum + dp->n);
+	dp->pool = (const char *)(dp->off + dp->n);
+	if (dp->pool[dp->pool_len - 1] != '\0')
+		return -1;
+
+	return 0;
+}
+
+int dict_open(struct dict_struct *dp, const char *fn)
+{
+	struct stat sb;
+	int fd;
+
+	memset(dp, 0, sizeof(*dp));
+
+	fd = open(fn, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		perror(fn);
+		return -1;
+	}
+	if (fstat(fd, &sb) < 0) {
+		perror(fn);
+		close(fd);
+		return -1;
+	}
+	dp->map_len = sb.st_size;
+	dp->map = mmap(NULL, dp->map_len, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (dp->map == MAP_FAILED) {
+		perror(fn);
+		dp->map = NULL;
+		return -1;
+	}
+	madvise(dp->map, dp->map_len, MADV_RANDOM);
+
+	if (dict_parse(dp) < 0) {
+		fprintf(stderr, "%s: not a dictionary; compile it with --compile\n", fn);
+		dict_close(dp);
+		return -1;
+	}
+	return 0;
+}
+
+void dict_close(struct dict_struct *dp)
+{
+	if (dp->map)
+		munmap(dp->map, dp->map_len);
+	memset(dp, 0, sizeof(*dp));
+}
+
+const char *dict_entry(const struct dict_struct *dp, int i)
+{
+	if (dp->off[i] >= dp->pool_len)
+		return "";
+	return dp->pool + dp->off[i];
+}
+
+/*
+ * The first entry whose running total is past x
+ */
+static int dict_find(const struct dict_struct *dp, double x)
+{
+	int lo = 0;
+	int hi = dp->n - 1;
+	int mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (dp->cum[mid] <= x)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+int dict_chooser(const struct dict_struct *dp)
+{
+	double total = dp->cum[dp->n - 1];
+
+	if (total <= 0.0)
+		return lrand48() % dp->n;
+	return dict_find(dp, drand48() * total);
+}
+
+int dict_chooser_r(const struct dict_struct *dp, unsigned short xsubi[3])
+{
+	double total = dp->cum[dp->n - 1];
+
+	if (total <= 0.0)
+		return nrand48(xsubi) % dp->n;
+	return dict_find(dp, erand48(xsubi) * total);
+}
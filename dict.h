@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2018 by Ross Wille. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * COPYING file for more details.
+ */
+
+#ifndef _DICT_H_
+#define _DICT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Longest word or phrase, in bytes.  The symbol queue is sized
+ * for the longest entry of the dictionary in use.
+ */
+#define DICT_MAX_LEN		128
+
+#define DICT_MAGIC		"CWD1"
+#define DICT_VERSION		2
+
+/*
+ * A compiled dictionary, in native byte order:
+ *
+ *   struct dict_header
+ *   double   cum[n]		running total of the weights
+ *   uint32_t off[n]		start of each entry in pool[]
+ *   char     pool[pool_len]	NUL-terminated entries
+ */
+struct dict_header {
+	char magic[4];
+	uint32_t version;
+	uint32_t n;
+	uint32_t pool_len;
+	uint32_t max_len;	/* longest entry, in bytes */
+	uint32_t reserved;
+};
+
+/*
+ * A dictionary mapped read-only, and shared with every other
+ * process that maps the same file.
+ */
+struct dict_struct {
+	void *map;
+	size_t map_len;
+	int n;
+	const double *cum;
+	const uint32_t *off;
+	const char *pool;
+	uint32_t pool_len;
+	int max_len;
+};
+
+extern struct dict_struct dictionary;
+
+extern int dict_compile(const char *text_fn, const char *fn);
+extern int dict_open(struct dict_struct *dp, const char *fn);
+extern void dict_close(struct dict_struct *dp);
+extern const char *dict_entry(const struct dict_struct *dp, int i);
+extern int dict_chooser(const struct dict_struct *dp);
+extern int dict_chooser_r(const struct dict_struct *dp, unsigned short xsubi[3]);
+
+#endif
@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2018 by Ross Wille. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * COPYING file for more details.
+ */
+
+/*
+ * Feedback sounds: any WAV file, converted once at startup to
+ * mono float at the output rate so that it queues and plays
+ * like any other symbol.  The files are loaded in parallel.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "config.h"
+#include "feedback.h"
+#include "riff.h"
+#include "src.h"
+
+struct sound_struct {
+	const char *name;
+	const char *fn;		/* NULL for none */
+	int fallback;		/* the default: missing is not an error */
+	int rate;
+	int rc;
+};
+
+struct symbol_struct feedback[N_FEEDBACK];
+
+static struct sound_struct sounds[N_FEEDBACK] = {
+	[FB_WRONG] = {"wrong", "wrong.wav", 1},
+	[FB_RIGHT] = {"right", NULL, 0},
+	[FB_REPEAT] = {"repeat", NULL, 0},
+};
+
+/*
+ * "NAME=FILE", or "NAME=" for no sound
+ */
+int feedback_set(const char *spec)
+{
+	const char *fn;
+	size_t len;
+	int i;
+
+	fn = strchr(spec, '=');
+	if (fn == NULL)
+		return -1;
+	len = fn++ - spec;
+
+	for (i = 0; i < N_FEEDBACK; i++) {
+		if ((strncmp(sounds[i].name, spec, len) == 0) && (sounds[i].name[len] == '\0')) {
+			sounds[i].fn = fn[0] ? fn : NULL;
+			sounds[i].fallback = 0;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+static void *feedback_task(void *cookie)
+{
+	struct sound_struct *sp = cookie;
+	struct symbol_struct *fp = &feedback[sp - sounds];
+	struct riff_struct riff;
+	struct src_struct src;
+	double ratio;
+	float *pcm;
+
+	sp->rc = -1;
+	if (riff_open(&riff, sp->fn) < 0)
+		return NULL;
+
+	ratio = (double)sp->rate / riff.rate;
+	if ((ratio < SRC_MIN_RATIO) || (ratio > SRC_MAX_RATIO)) {
+		fprintf(stderr, "%s: %d Hz sample rate not supported\n", sp->fn, riff.rate);
+		riff_close(&riff);
+		return NULL;
+	}
+
+	pcm = riff_read_mono(&riff);
+	fp->samples = riff.frames;
+	fp->pcm = pcm;
+	if (pcm == NULL) {
+		fprintf(stderr, "%s: out of memory\n", sp->fn);
+	}
+	else if (riff.rate != sp->rate) {
+		fp->pcm = NULL;
+		if (src_init(&src, riff.rate, sp->rate, settings.src_quality) < 0) {
+			fprintf(stderr, "%s: cannot resample %d Hz to %d Hz\n", sp->fn,
+				riff.rate, sp->rate);
+		}
+		else {
+			fp->samples = src_length(&src, riff.frames);
+			fp->pcm = malloc((fp->samples ? fp->samples : 1) * sizeof(float));
+			if ((fp->pcm == NULL) || (src_run(&src, fp->pcm, pcm, riff.frames) < 0)) {
+				/* src_run() fails only to allocate */
+				fprintf(stderr, "%s: out of memory\n", sp->fn);
+				free(fp->pcm);
+				fp->pcm = NULL;
+			}
+		}
+		src_fini(&src);
+		free(pcm);
+	}
+	riff_close(&riff);
+
+	if (fp->pcm == NULL)
+		return NULL;
+	fp->units = 0;
+	sp->rc = 0;
+
+	return NULL;
+}
+
+/*
+ * Load every configured sound, resampled to rate.  Only the
+ * default sound may be missing.
+ */
+int feedback_load(int rate)
+{
+	pthread_t threads[N_FEEDBACK];
+	int started[N_FEEDBACK];
+	int rc = 0;
+	int i;
+
+	for (i = 0; i < N_FEEDBACK; i++) {
+		started[i] = 0;
+		if (sounds[i].fn == NULL)
+			continue;
+		sounds[i].rate = rate;
+		if (pthread_create(&threads[i], NULL, feedback_task, &sounds[i]) == 0)
+			started[i] = 1;
+		else
+			feedback_task(&sounds[i]);
+	}
+
+	for (i = 0; i < N_FEEDBACK; i++) {
+		if (started[i])
+			pthread_join(threads[i], NULL);
+		if ((sounds[i].fn == NULL) || (sounds[i].rc == 0))
+			continue;
+		fprintf(stderr, "no %s sound\n", sounds[i].name);
+		if (!sounds[i].fallback)
+			rc = -1;
+	}
+	return rc;
+}
+
+void feedback_free(void)
+{
+	int i;
+
+	for (i = 0; i < N_FEEDBACK; i++) {
+		free(feedback[i].pcm);
+		memset(&feedback[i], 0, sizeof(feedback[i]));
+	}
+}
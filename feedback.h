@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2018 by Ross Wille. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * COPYING file for more details.
+ */
+
+#ifndef _FEEDBACK_H_
+#define _FEEDBACK_H_
+
+#include "symbols.h"
+
+/*
+ * Sounds played in answer to a key
+ */
+#define FB_WRONG		0
+#define FB_RIGHT		1
+#define FB_REPEAT		2
+#define N_FEEDBACK		3
+
+/* pcm is NULL for a sound that is not configured */
+extern struct symbol_struct feedback[N_FEEDBACK];
+
+extern int feedback_set(const char *spec);
+extern int feedback_load(int rate);
+extern void feedback_free(void);
+
+#endif
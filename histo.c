@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2018 by Ross Wille. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * COPYING file for more details.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "histo.h"
+
+#define HISTO_LIMIT		((1ULL << HISTO_MAX_BITS) - 1)
+
+static int histo_index(unsigned long long v)
+{
+	int k;
+
+	if (v < HISTO_SUB)
+		return v;
+
+	/* v is in [2^k, 2^(k+1)); keep its top HISTO_SUB_BITS + 1 bits */
+	k = 63 - __builtin_clzll(v);
+	return (k - HISTO_SUB_BITS + 1) * HISTO_SUB +
+		((v >> (k - HISTO_SUB_BITS)) & (HISTO_SUB - 1));
+}
+
+/*
+ * The largest value that lands in bucket i
+ */
+static unsigned long long histo_bound(int i)
+{
+	int g = i / HISTO_SUB;
+	int sub = i % HISTO_SUB;
+
+	if (g == 0)
+		return sub;
+	return ((unsigned long long)(HISTO_SUB + sub + 1) << (g - 1)) - 1;
+}
+
+void histo_init(struct histo_struct *hp, const char *name)
+{
+	memset(hp, 0, sizeof(*hp));
+	hp->name = name;
+}
+
+void histo_add(struct histo_struct *hp, long long value)
+{
+	unsigned long long v;
+
+	v = (value < 0) ? 0 : value;
+	if (v > HISTO_LIMIT)
+		v = HISTO_LIMIT;
+
+	hp->buckets[histo_index(v)]++;
+	if ((hp->count == 0) || (v < hp->min))
+		hp->min = v;
+	if (v > hp->max)
+		hp->max = v;
+	hp->sum += v;
+	hp->count++;
+}
+
+/*
+ * Upper bound of the bucket holding the pct'th percentile
+ */
+unsigned long long histo_percentile(const struct histo_struct *hp, double pct)
+{
+	unsigned long long want;
+	unsigned long long seen;
+	int i;
+
+	if (hp->count == 0)
+		return 0;
+
+	want = hp->count * pct / 100.0 + 0.5;
+	if (want < 1)
+		want = 1;
+	seen = 0;
+	for (i = 0; i < HISTO_BUCKETS; i++) {
+		seen += hp->buckets[i];
+		if (seen >= want)
+			return (histo_bound(i) < hp->max) ? histo_bound(i) : hp->max;
+	}
+	return hp->max;
+}
+
+/*
+ * One line: count, p50, p99 and max, divided by scale
+ */
+void histo_print(const struct histo_struct *hp, FILE *fp, double scale,
+	const char *units)
+{
+	if (hp->count == 0) {
+		fprintf(fp, "%20s: no samples\r\n", hp->name);
+		return;
+	}
+	fprintf(fp, "%20s: n=%llu p50=%0.2f p99=%0.2f max=%0.2f mean=%0.2f %s\r\n",
+		hp->name, hp->count,
+		histo_percentile(hp, 50.0) / scale,
+		histo_percentile(hp, 99.0) / scale,
+		hp->max / scale,
+		hp->sum / hp->count / scale, units);
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2018 by Ross Wille. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * COPYING file for more details.
+ */
+
+#ifndef _HISTO_H_
+#define _HISTO_H_
+
+#include <stdio.h>
+
+/*
+ * Log-linear histogram: each power of two is split into
+ * HISTO_SUB linear buckets, so any value is recorded within
+ * 1/HISTO_SUB of itself.  Fixed size, so recording never
+ * allocates and is safe in the audio thread.
+ */
+#define HISTO_SUB_BITS		4
+#define HISTO_SUB		(1 << HISTO_SUB_BITS)
+#define HISTO_MAX_BITS		40	/* values up to 2^40, ~18 minutes of ns */
+#define HISTO_BUCKETS		((HISTO_MAX_BITS - HISTO_SUB_BITS + 1) * HISTO_SUB)
+
+struct histo_struct {
+	const char *name;
+	unsigned long long count;
+	unsigned long long min;
+	unsigned long long max;
+	double sum;
+	unsigned int buckets[HISTO_BUCKETS];
+};
+
+extern void histo_init(struct histo_struct *hp, const char *name);
+extern void histo_add(struct histo_struct *hp, long long value);
+extern unsigned long long histo_percentile(const struct histo_struct *hp, double pct);
+extern void histo_print(const struct histo_struct *hp, FILE *fp, double scale,
+	const char *units);
+
+#endif
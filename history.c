@@ -0,0 +1,473 @@
+/*
+ * Copyright (C) 2018 by Ross Wille. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * COPYING file for more details.
+ */
+
+/*
+ * Columnar trial history.
+ *
+ * The journal hands its records over here when it compacts.
+ * The last block is filled in place and a new one started when
+ * it is full; its columns are synced before its index and the
+ * file header that make them visible, so a crash never exposes
+ * a torn row.  Records already present (by journal sequence
+ * and time) are skipped, so handing the same ones over twice
+ * is harmless.
+ *
+ * A query maps the file and scans only the blocks whose index
+ * can match, a column at a time.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "history.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SCAN_KERNEL	__attribute__((target_clones("avx2", "default")))
+#else
+#define SCAN_KERNEL
+#endif
+
+static off_t block_offset(int i)
+{
+	return sizeof(struct hist_header) + (off_t)i * HIST_BLOCK_SIZE;
+}
+
+static int header_ok(const struct hist_header *hp)
+{
+	return (memcmp(hp->magic, HIST_MAGIC, sizeof(hp->magic)) == 0) &&
+		(hp->version == HIST_VERSION) && (hp->block_rows == HIST_ROWS);
+}
+
+/*
+ * A block may only hold symbols of the table: its rows index
+ * the per-symbol counters.
+ */
+static int block_ok(const struct hist_block *bp, int n_cw)
+{
+	uint64_t valid;
+	int lo;
+	int w;
+
+	if (bp->n > HIST_ROWS)
+		return 0;
+	for (w = 0; w < HIST_SYMBOLS / 64; w++) {
+		lo = w * 64;
+		if (n_cw >= lo + 64)
+			valid = ~0ULL;
+		else if (n_cw <= lo)
+			valid = 0;
+		else
+			valid = (1ULL << (n_cw - lo)) - 1;
+		if (bp->sym_mask[w] & ~valid)
+			return 0;
+	}
+	return 1;
+}
+
+static void block_add(struct hist_block *bp, const struct journal_rec *rp)
+{
+	int i = bp->n;
+
+	if ((i == 0) || (rp->time_ns < bp->t_min))
+		bp->t_min = rp->time_ns;
+	if ((i == 0) || (rp->time_ns > bp->t_max))
+		bp->t_max = rp->time_ns;
+	if ((i == 0) || (rp->react_ms < bp->react_min))
+		bp->react_min = rp->react_ms;
+	if ((i == 0) || (rp->react_ms > bp->react_max))
+		bp->react_max = rp->react_ms;
+	bp->sym_mask[rp->sym / 64] |= 1ULL << (rp->sym % 64);
+
+	HIST_COL(bp, TIME, int64_t)[i] = rp->time_ns;
+	HIST_COL(bp, REACT, float)[i] = rp->react_ms;
+	HIST_COL(bp, WEIGHT, float)[i] = rp->weight;
+	HIST_COL(bp, SYM, uint8_t)[i] = rp->sym;
+	HIST_COL(bp, RESULT, uint8_t)[i] = rp->result;
+	HIST_COL(bp, ANSWER, int8_t)[i] = rp->answer;
+	bp->n++;
+}
+
+/*
+ * Columns first, then the index that counts them
+ */
+static int block_write(int fd, int i, const struct hist_block *bp)
+{
+	const char *p = (const char *)bp;
+	size_t len;
+
+	len = HIST_BLOCK_SIZE - sizeof(*bp);
+	if (pwrite(fd, p + sizeof(*bp), len, block_offset(i) + sizeof(*bp)) != (ssize_t)len)
+		return -1;
+	if (fdatasync(fd) < 0)
+		return -1;
+	if (pwrite(fd, bp, sizeof(*bp), block_offset(i)) != sizeof(*bp))
+		return -1;
+	return 0;
+}
+
+int hist_append(const char *path, const struct journal_rec *recs, int n,
+	int n_cw, const char *student)
+{
+	struct hist_header hdr;
+	struct hist_block *bp;
+	struct stat sb;
+	int dirty;
+	int cur;
+	int rc;
+	int fd;
+	int i;
+
+	fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0)
+		return -1;
+	bp = calloc(1, HIST_BLOCK_SIZE);
+
+	rc = -1;
+	do {
+		if ((bp == NULL) || (fstat(fd, &sb) < 0))
+			break;
+
+		if (sb.st_size == 0) {
+			memset(&hdr, 0, sizeof(hdr));
+			memcpy(hdr.magic, HIST_MAGIC, sizeof(hdr.magic));
+			hdr.version = HIST_VERSION;
+			hdr.block_rows = HIST_ROWS;
+			hdr.n_cw = n_cw;
+			snprintf(hdr.student, sizeof(hdr.student), "%s", student);
+		}
+		else if ((pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)) ||
+			 !header_ok(&hdr) || (hdr.n_cw != (uint32_t)n_cw)) {
+			errno = EINVAL;
+			break;
+		}
+
+		/* carry on filling the last block */
+		cur = hdr.n_blocks - 1;
+		if ((cur >= 0) &&
+		    (pread(fd, bp, HIST_BLOCK_SIZE, block_offset(cur)) != HIST_BLOCK_SIZE))
+			break;
+		if ((cur < 0) || (bp->n >= HIST_ROWS)) {
+			memset(bp, 0, HIST_BLOCK_SIZE);
+			cur++;
+		}
+
+		dirty = 0;
+		for (i = 0; i < n; i++) {
+			if ((recs[i].seq <= hdr.last_seq) && (recs[i].time_ns <= hdr.last_time))
+				continue;
+			if (recs[i].sym >= hdr.n_cw)
+				continue;
+			if (bp->n == HIST_ROWS) {
+				if (block_write(fd, cur, bp) < 0)
+					break;
+				hdr.n_blocks = ++cur;
+				memset(bp, 0, HIST_BLOCK_SIZE);
+			}
+			block_add(bp, &recs[i]);
+			hdr.last_seq = recs[i].seq;
+			hdr.last_time = recs[i].time_ns;
+			dirty = 1;
+		}
+		if (i < n)
+			break;
+
+		if (dirty) {
+			if (block_write(fd, cur, bp) < 0)
+				break;
+			hdr.n_blocks = cur + 1;
+		}
+		if ((pwrite(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)) || (fdatasync(fd) < 0))
+			break;
+		rc = 0;
+	} while (0);
+
+	free(bp);
+	close(fd);
+	return rc;
+}
+
+int hist_open(struct hist_struct *hp, const char *fn)
+{
+	struct stat sb;
+	int fd;
+
+	memset(hp, 0, sizeof(*hp));
+
+	fd = open(fn, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		perror(fn);
+		return -1;
+	}
+	if (fstat(fd, &sb) < 0) {
+		perror(fn);
+		close(fd);
+		return -1;
+	}
+	hp->map_len = sb.st_size;
+	if (hp->map_len < sizeof(*hp->hdr)) {
+		fprintf(stderr, "%s: not a history file\n", fn);
+		close(fd);
+		return -1;
+	}
+	hp->map = mmap(NULL, hp->map_len, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (hp->map == MAP_FAILED) {
+		perror(fn);
+		hp->map = NULL;
+		return -1;
+	}
+	madvise(hp->map, hp->map_len, MADV_SEQUENTIAL);
+
+	hp->hdr = hp->map;
+	hp->n_blocks = hp->hdr->n_blocks;
+	if (!header_ok(hp->hdr) || (hp->hdr->n_cw > HIST_SYMBOLS) ||
+	    (hp->map_len < (size_t)block_offset(hp->n_blocks))) {
+		fprintf(stderr, "%s: not a history file\n", fn);
+		hist_close(hp);
+		return -1;
+	}
+	return 0;
+}
+
+void hist_close(struct hist_struct *hp)
+{
+	if (hp->map)
+		munmap(hp->map, hp->map_len);
+	memset(hp, 0, sizeof(*hp));
+}
+
+const struct hist_block *hist_block(const struct hist_struct *hp, int i)
+{
+	return (const struct hist_block *)((const char *)hp->map + block_offset(i));
+}
+
+int hist_stats_init(struct hist_stats *sp, const struct hist_query *qp)
+{
+	int i;
+
+	memset(sp, 0, sizeof(*sp));
+	for (i = 0; i < HIST_SYMBOLS; i++)
+		histo_init(&sp->react[i], NULL);
+	if (qp->n_periods) {
+		sp->period_right = calloc(qp->n_periods, sizeof(long long));
+		sp->period_total = calloc(qp->n_periods, sizeof(long long));
+		if ((sp->period_right == NULL) || (sp->period_total == NULL)) {
+			hist_stats_fini(sp);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+void hist_stats_fini(struct hist_stats *sp)
+{
+	free(sp->period_right);
+	free(sp->period_total);
+	sp->period_right = NULL;
+	sp->period_total = NULL;
+}
+
+/*
+ * The filters are computed a column at a time into masks,
+ * without branches so that they vectorize; only the rows that
+ * pass are then counted.  Rows of symbols outside the table
+ * never pass.
+ */
+SCAN_KERNEL
+static void scan_block(const struct hist_block *bp, const struct hist_query *qp,
+	struct hist_stats *sp)
+{
+	const int64_t *t = HIST_COL(bp, TIME, const int64_t);
+	const float *react = HIST_COL(bp, REACT, const float);
+	const uint8_t *sym = HIST_COL(bp, SYM, const uint8_t);
+	const uint8_t *result = HIST_COL(bp, RESULT, const uint8_t);
+	uint8_t keep[HIST_ROWS];
+	int32_t period[HIST_ROWS];
+	double per_ns;
+	int n = bp->n;
+	int p;
+	int s;
+	int i;
+
+	for (i = 0; i < n; i++)
+		keep[i] = (sym[i] < qp->n_cw);
+	if ((bp->t_min < qp->since) || (bp->t_max >= qp->until)) {
+		for (i = 0; i < n; i++)
+			keep[i] &= (t[i] >= qp->since) & (t[i] < qp->until);
+	}
+	if (qp->sym >= 0) {
+		for (i = 0; i < n; i++)
+			keep[i] &= (sym[i] == qp->sym);
+	}
+	if (qp->n_periods) {
+		per_ns = 1.0 / qp->every;
+		for (i = 0; i < n; i++) {
+			p = (t[i] - qp->t0) * per_ns;
+			p = (p < 0) ? 0 : p;
+			period[i] = (p < qp->n_periods) ? p : qp->n_periods - 1;
+		}
+	}
+
+	for (i = 0; i < n; i++) {
+		if (!keep[i])
+			continue;
+		s = sym[i];
+		if (result[i] == JR_REPEAT) {
+			sp->again[s]++;
+			continue;
+		}
+		if (result[i] == JR_RIGHT)
+			sp->right[s]++;
+		else
+			sp->wrong[s]++;
+		histo_add(&sp->react[s], react[i] * 1000.0f);
+		if (qp->n_periods) {
+			sp->period_total[period[i]]++;
+			sp->period_right[period[i]] += (result[i] == JR_RIGHT);
+		}
+	}
+	sp->rows += n;
+}
+
+void hist_scan(const struct hist_struct *hp, const struct hist_query *qp,
+	struct hist_stats *sp)
+{
+	const struct hist_block *bp;
+	struct hist_query q = *qp;
+	int i;
+
+	q.n_cw = hp->hdr->n_cw;
+	for (i = 0; i < hp->n_blocks; i++) {
+		bp = hist_block(hp, i);
+		sp->blocks++;
+		if (!block_ok(bp, q.n_cw)) {
+			sp->bad++;
+			continue;
+		}
+		if ((bp->n == 0) ||
+		    (bp->t_max < q.since) || (bp->t_min >= q.until) ||
+		    ((q.sym >= 0) && !(bp->sym_mask[q.sym / 64] & (1ULL << (q.sym % 64))))) {
+			sp->skipped++;
+			continue;
+		}
+		scan_block(bp, &q, sp);
+	}
+}
+
+#ifdef MAIN
+#include <time.h>
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1.0e9;
+}
+
+static void bench(const char *what, const struct hist_struct *hp, const struct hist_query *qp)
+{
+	struct hist_stats st;
+	long long answers;
+	double t;
+	int s;
+
+	hist_stats_init(&st, qp);
+	t = now();
+	hist_scan(hp, qp, &st);
+	t = now() - t;
+
+	answers = 0;
+	for (s = 0; s < HIST_SYMBOLS; s++)
+		answers += st.right[s] + st.wrong[s] + st.again[s];
+	printf("%-22s %10lld of %10lld rows, %5lld/%lld blocks skipped, %7.1f ms, %6.0f Mrows/s\n",
+		what, answers, st.rows, st.skipped, st.blocks, t * 1000.0,
+		st.rows / t / 1.0e6);
+	hist_stats_fini(&st);
+}
+
+/*
+ * Build a history of synthetic trials in memory, laid out as
+ * the file is, and time some queries on it
+ */
+int main(int argc, char *argv[])
+{
+	unsigned short xsubi[3] = {1, 2, 3};
+	struct hist_header *hdr;
+	struct hist_struct h;
+	struct hist_query q;
+	struct journal_rec rec;
+	struct hist_block *bp;
+	long long rows;
+	int64_t t0;
+	long long i;
+
+	rows = (argc > 1) ? atoll(argv[1]) : 20000000;
+
+	memset(&h, 0, sizeof(h));
+	h.n_blocks = (rows + HIST_ROWS - 1) / HIST_ROWS;
+	h.map_len = block_offset(h.n_blocks);
+	h.map = mmap(NULL, h.map_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (h.map == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	hdr = h.map;
+	hdr->n_cw = 43;
+	h.hdr = hdr;
+
+	/* a year of trials, one every 1.5 s on average */
+	t0 = 1700000000LL * 1000000000LL;
+	memset(&rec, 0, sizeof(rec));
+	for (i = 0; i < rows; i++) {
+		bp = (struct hist_block *)hist_block(&h, i / HIST_ROWS);
+		rec.time_ns = t0 + (int64_t)(i * 1.5e9);
+		rec.sym = nrand48(xsubi) % hdr->n_cw;
+		rec.result = nrand48(xsubi) % 10;
+		rec.result = (rec.result < 7) ? JR_RIGHT : (rec.result < 9) ? JR_WRONG : JR_REPEAT;
+		rec.react_ms = 300.0 + 2000.0 * erand48(xsubi);
+		block_add(bp, &rec);
+	}
+	hdr->n_blocks = h.n_blocks;
+
+	q.since = INT64_MIN;
+	q.until = INT64_MAX;
+	q.sym = -1;
+	q.t0 = t0;
+	q.every = 0;
+	q.n_periods = 0;
+	bench("all", &h, &q);
+
+	q.sym = 4;
+	bench("one symbol", &h, &q);
+
+	q.sym = -1;
+	q.since = t0 + (int64_t)(rows * 1.5e9 * 0.9);
+	bench("last 10% of the time", &h, &q);
+
+	q.since = INT64_MIN;
+	q.every = 7 * 86400LL * 1000000000LL;
+	q.n_periods = rows * 1.5e9 / q.every + 1;
+	bench("weekly curve", &h, &q);
+
+	munmap(h.map, h.map_len);
+	return 0;
+}
+#endif
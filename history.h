@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2018 by Ross Wille. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * COPYING file for more details.
+ */
+
+#ifndef _HISTORY_H_
+#define _HISTORY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "histo.h"
+#include "journal.h"
+
+#define HIST_FILE		".cw-trainer.history"
+#define HIST_MAGIC		"CWH1"
+#define HIST_VERSION		1
+#define HIST_ROWS		4096	/* per block */
+#define HIST_SYMBOLS		128	/* a symbol index is a byte */
+
+/*
+ * A history file is a header and then blocks of HIST_ROWS
+ * trials stored by column, each with a small index: the time
+ * range, reaction time range and the set of symbols it holds,
+ * so a query skips whole blocks without touching their rows.
+ * Native byte order; it is mapped, not parsed.
+ */
+struct hist_header {
+	char magic[4];
+	uint32_t version;
+	uint32_t block_rows;
+	uint32_t n_blocks;
+	uint32_t n_cw;
+	uint32_t last_seq;	/* of the journal record last added */
+	int64_t last_time;
+	char student[32];
+};
+
+struct hist_block {
+	uint32_t n;		/* rows used */
+	uint32_t reserved;
+	int64_t t_min;
+	int64_t t_max;
+	float react_min;
+	float react_max;
+	uint64_t sym_mask[HIST_SYMBOLS / 64];
+	uint8_t pad[16];
+	/* followed by the columns */
+};
+
+#define HIST_COL_TIME		sizeof(struct hist_block)
+#define HIST_COL_REACT		(HIST_COL_TIME + HIST_ROWS * sizeof(int64_t))
+#define HIST_COL_WEIGHT		(HIST_COL_REACT + HIST_ROWS * sizeof(float))
+#define HIST_COL_SYM		(HIST_COL_WEIGHT + HIST_ROWS * sizeof(float))
+#define HIST_COL_RESULT		(HIST_COL_SYM + HIST_ROWS)
+#define HIST_COL_ANSWER		(HIST_COL_RESULT + HIST_ROWS)
+#define HIST_BLOCK_SIZE		((HIST_COL_ANSWER + HIST_ROWS + 63) & ~63UL)
+
+#define HIST_COL(_bp, _col, _type)	((_type *)((char *)(_bp) + HIST_COL_##_col))
+
+/*
+ * A history file mapped read-only
+ */
+struct hist_struct {
+	void *map;
+	size_t map_len;
+	const struct hist_header *hdr;
+	int n_blocks;
+};
+
+/*
+ * Trials from since (inclusive) to until (exclusive), of one
+ * symbol or all (-1).  With every > 0, the right and wrong
+ * answers are also counted per period of every ns from t0.
+ */
+struct hist_query {
+	int64_t since;
+	int64_t until;
+	int sym;
+	int64_t t0;
+	int64_t every;
+	int n_periods;
+	int n_cw;		/* of the file, set by hist_scan() */
+};
+
+struct hist_stats {
+	long long right[HIST_SYMBOLS];
+	long long wrong[HIST_SYMBOLS];
+	long long again[HIST_SYMBOLS];
+	struct histo_struct react[HIST_SYMBOLS];	/* us */
+	long long *period_right;
+	long long *period_total;
+	long long rows;		/* scanned */
+	long long blocks;
+	long long skipped;	/* blocks ruled out by their index */
+	long long bad;		/* blocks whose index is corrupt */
+};
+
+extern int hist_append(const char *path, const struct journal_rec *recs, int n,
+	int n_cw, const char *student);
+extern int hist_open(struct hist_struct *hp, const char *fn);
+extern void hist_close(struct hist_struct *hp);
+extern const struct hist_block *hist_block(const struct hist_struct *hp, int i);
+extern int hist_stats_init(struct hist_stats *sp, const struct hist_query *qp);
+extern void hist_stats_fini(struct hist_stats *sp);
+extern void hist_scan(const struct hist_struct *hp, const struct hist_query *qp,
+	struct hist_stats *sp);
+
+#endif
@@ -0,0 +1,379 @@
+/*
+ * Copyright (C) 2018 by Ross Wille. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * COPYING file for more details.
+ */
+
+/*
+ * Crash-safe learning journal.
+ *
+ * Every answer is appended to ~/.cw-trainer.journal as a fixed
+ * size record.  The key handler only copies the record into a
+ * pending buffer; the journal thread writes what has gathered
+ * in a commit window with one write() and one fdatasync().
+ *
+ * Every JOURNAL_COMPACT records the records are added to the
+ * trial history (history.c), the weights are snapshot into
+ * the config file, with the sequence number of the last record
+ * they include, and the journal is cut back to its header.  At
+ * startup the records past the snapshot are replayed.  A record
+ * holds the scale it applied, so replay works on the snapshot's
+ * normalized weights, and a crash between the snapshot and the
+ * cut only leaves records that replay skips.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <linux/limits.h>
+#include <sys/stat.h>
+
+#include "config.h"
+#include "history.h"
+#include "morse.h"
+#include "journal.h"
+
+#define JOURNAL_PENDING		256
+
+struct journal_struct {
+	int fd;
+	char path[PATH_MAX];
+	char hist_path[PATH_MAX];
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int running;
+	int stop;
+	uint32_t seq;		/* last assigned */
+	struct journal_rec pending[JOURNAL_PENDING];
+	int n_pending;
+	long dropped;		/* pending buffer full */
+	/* the journal thread's own */
+	struct journal_rec batch[JOURNAL_PENDING];
+	float weight[MAX_SYMBOLS];
+	uint32_t committed;	/* seq of the last record written */
+	int since_snapshot;
+	int failed;
+	int hist_failed;
+};
+
+static struct journal_struct jn = {
+	.fd = -1,
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+};
+
+static uint32_t crc32(const void *buf, size_t len)
+{
+	const unsigned char *p = buf;
+	uint32_t crc = 0xffffffff;
+	int k;
+
+	while (len--) {
+		crc ^= *p++;
+		for (k = 0; k < 8; k++)
+			crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+	}
+	return ~crc;
+}
+
+static uint32_t rec_crc(const struct journal_rec *rp)
+{
+	return crc32((const char *)rp + sizeof(rp->crc), sizeof(*rp) - sizeof(rp->crc));
+}
+
+static void journal_path(void)
+{
+	config_home_path(jn.path, sizeof(jn.path), JOURNAL_FILE);
+	config_home_path(jn.hist_path, sizeof(jn.hist_path), HIST_FILE);
+}
+
+static int header_ok(const struct journal_header *hp)
+{
+	return (memcmp(hp->magic, JOURNAL_MAGIC, sizeof(hp->magic)) == 0) &&
+		(hp->version == JOURNAL_VERSION) && (hp->n_cw == (uint32_t)n_cw);
+}
+
+/*
+ * Apply the records past the config snapshot to cw[].  Returns
+ * the number applied, or -1 if the journal is unreadable.
+ */
+int journal_replay(void)
+{
+	struct journal_header hdr;
+	struct journal_rec rec;
+	int applied = 0;
+	int fd;
+
+	journal_path();
+	jn.seq = config_seq;
+
+	fd = open(jn.path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return (errno == ENOENT) ? 0 : -1;
+
+	if ((read(fd, &hdr, sizeof(hdr)) != sizeof(hdr)) || !header_ok(&hdr)) {
+		close(fd);
+		return -1;
+	}
+	while (read(fd, &rec, sizeof(rec)) == sizeof(rec)) {
+		if ((rec.crc != rec_crc(&rec)) || (rec.sym >= n_cw))
+			break;
+		if (rec.seq > jn.seq)
+			jn.seq = rec.seq;
+		if (rec.seq <= config_seq)
+			continue;
+		cw[rec.sym].weight *= rec.scale;
+		applied++;
+	}
+	close(fd);
+
+	return applied;
+}
+
+/*
+ * Open the journal for appending, dropping a torn tail, or
+ * start a new one if it is missing or of another table
+ */
+static int journal_open(void)
+{
+	struct journal_header hdr;
+	struct journal_rec rec;
+	off_t good;
+
+	jn.fd = open(jn.path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (jn.fd < 0)
+		return -1;
+
+	good = 0;
+	if ((read(jn.fd, &hdr, sizeof(hdr)) == sizeof(hdr)) && header_ok(&hdr)) {
+		good = sizeof(hdr);
+		while ((read(jn.fd, &rec, sizeof(rec)) == sizeof(rec)) &&
+		       (rec.crc == rec_crc(&rec)) && (rec.sym < n_cw))
+			good += sizeof(rec);
+	}
+
+	if (good == 0) {
+		memset(&hdr, 0, sizeof(hdr));
+		memcpy(hdr.magic, JOURNAL_MAGIC, sizeof(hdr.magic));
+		hdr.version = JOURNAL_VERSION;
+		hdr.n_cw = n_cw;
+		if ((ftruncate(jn.fd, 0) < 0) ||
+		    (pwrite(jn.fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)))
+			return -1;
+		good = sizeof(hdr);
+	}
+	if ((ftruncate(jn.fd, good) < 0) || (lseek(jn.fd, good, SEEK_SET) < 0) ||
+	    (fdatasync(jn.fd) < 0))
+		return -1;
+	jn.since_snapshot = (good - sizeof(hdr)) / sizeof(rec);
+
+	return 0;
+}
+
+/*
+ * Hand the records since the last snapshot to the history.  A
+ * failure there is reported once and does not stop compaction.
+ */
+static void journal_history(void)
+{
+	struct journal_rec *recs;
+	const char *student;
+	ssize_t len;
+
+	if ((jn.since_snapshot == 0) || jn.hist_failed)
+		return;
+
+	len = jn.since_snapshot * sizeof(*recs);
+	recs = malloc(len);
+	if ((recs == NULL) ||
+	    (pread(jn.fd, recs, len, sizeof(struct journal_header)) != len)) {
+		free(recs);
+		return;
+	}
+	student = getenv("USER");
+	if (hist_append(jn.hist_path, recs, jn.since_snapshot, n_cw, student ? student : "") < 0) {
+		perror(jn.hist_path);
+		jn.hist_failed = 1;
+	}
+	free(recs);
+}
+
+/*
+ * Move the records into the history, snapshot the weights into
+ * the config file, then cut the journal back to its header
+ */
+static int journal_compact(void)
+{
+	journal_history();
+	if (config_save(jn.weight, jn.committed) < 0)
+		return -1;
+	config_seq = jn.committed;
+	if ((ftruncate(jn.fd, sizeof(struct journal_header)) < 0) ||
+	    (lseek(jn.fd, sizeof(struct journal_header), SEEK_SET) < 0) ||
+	    (fdatasync(jn.fd) < 0))
+		return -1;
+	jn.since_snapshot = 0;
+	return 0;
+}
+
+static int journal_commit(int n)
+{
+	ssize_t len;
+	int i;
+
+	len = n * sizeof(jn.batch[0]);
+	if (write(jn.fd, jn.batch, len) != len)
+		return -1;
+	if (fdatasync(jn.fd) < 0)
+		return -1;
+
+	for (i = 0; i < n; i++)
+		jn.weight[jn.batch[i].sym] *= jn.batch[i].scale;
+	jn.committed = jn.batch[n - 1].seq;
+	jn.since_snapshot += n;
+
+	if (jn.since_snapshot >= JOURNAL_COMPACT)
+		return journal_compact();
+	return 0;
+}
+
+static void *journal_task(void *cookie)
+{
+	struct timespec ts;
+	int n;
+
+	pthread_mutex_lock(&jn.lock);
+	while (1) {
+		while ((jn.n_pending == 0) && !jn.stop)
+			pthread_cond_wait(&jn.cond, &jn.lock);
+		if (jn.n_pending == 0)
+			break;
+
+		/* let the rest of the group gather */
+		if (!jn.stop) {
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_nsec += JOURNAL_COMMIT_MS * 1000000L;
+			ts.tv_sec += ts.tv_nsec / 1000000000L;
+			ts.tv_nsec %= 1000000000L;
+			while (!jn.stop && (jn.n_pending < JOURNAL_PENDING) &&
+			       (pthread_cond_timedwait(&jn.cond, &jn.lock, &ts) == 0))
+				;
+		}
+
+		n = jn.n_pending;
+		memcpy(jn.batch, jn.pending, n * sizeof(jn.batch[0]));
+		jn.n_pending = 0;
+		pthread_mutex_unlock(&jn.lock);
+
+		if (!jn.failed && (journal_commit(n) < 0)) {
+			perror(jn.path);
+			jn.failed = 1;
+		}
+
+		pthread_mutex_lock(&jn.lock);
+	}
+	pthread_mutex_unlock(&jn.lock);
+
+	return NULL;
+}
+
+/*
+ * After journal_replay(), with cw[] holding the weights the
+ * session starts from
+ */
+int journal_start(void)
+{
+	int i;
+
+	if (journal_open() < 0) {
+		perror(jn.path);
+		if (jn.fd >= 0)
+			close(jn.fd);
+		jn.fd = -1;
+		return -1;
+	}
+
+	for (i = 0; i < n_cw; i++)
+		jn.weight[i] = cw[i].weight;
+	jn.committed = jn.seq;
+	jn.stop = 0;
+	if (pthread_create(&jn.thread, NULL, journal_task, NULL) != 0) {
+		close(jn.fd);
+		jn.fd = -1;
+		return -1;
+	}
+	jn.running = 1;
+
+	return 0;
+}
+
+/*
+ * Called from the key handler: stamps the record and hands it
+ * to the journal thread without waiting for the disk
+ */
+void journal_append(struct journal_rec *rp)
+{
+	struct timespec ts;
+
+	if (!jn.running)
+		return;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	rp->time_ns = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+
+	pthread_mutex_lock(&jn.lock);
+	if (jn.n_pending < JOURNAL_PENDING) {
+		rp->seq = ++jn.seq;
+		rp->crc = rec_crc(rp);
+		jn.pending[jn.n_pending++] = *rp;
+		pthread_cond_signal(&jn.cond);
+	}
+	else
+		jn.dropped++;
+	pthread_mutex_unlock(&jn.lock);
+}
+
+/*
+ * Commit what is pending and compact, so a clean exit leaves an
+ * empty journal.  Without a working journal, save cw[], which
+ * holds every answer up to jn.seq.
+ */
+void journal_stop(void)
+{
+	if (!jn.running) {
+		config_seq = jn.seq;
+		config_write();
+		return;
+	}
+
+	pthread_mutex_lock(&jn.lock);
+	jn.stop = 1;
+	pthread_cond_signal(&jn.cond);
+	pthread_mutex_unlock(&jn.lock);
+	pthread_join(jn.thread, NULL);
+	jn.running = 0;
+
+	if (jn.dropped)
+		fprintf(stderr, "journal: %ld answers not recorded\n", jn.dropped);
+	if (jn.failed || (journal_compact() < 0)) {
+		config_seq = jn.seq;
+		config_write();
+	}
+
+	close(jn.fd);
+	jn.fd = -1;
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2018 by Ross Wille. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * COPYING file for more details.
+ */
+
+#ifndef _JOURNAL_H_
+#define _JOURNAL_H_
+
+#include <stdint.h>
+
+#define JOURNAL_FILE		".cw-trainer.journal"
+#define JOURNAL_MAGIC		"CWJ1"
+#define JOURNAL_VERSION		1
+#define JOURNAL_COMMIT_MS	200	/* group commit window */
+#define JOURNAL_COMPACT		1024	/* records between snapshots */
+
+#define JR_RIGHT		0
+#define JR_WRONG		1
+#define JR_REPEAT		2
+
+struct journal_header {
+	char magic[4];
+	uint32_t version;
+	uint32_t n_cw;		/* symbol indexes depend on the table */
+	uint32_t reserved;
+};
+
+/*
+ * One answer.  The reaction time runs from the symbol being
+ * queued to the key.  crc covers the rest of the record, so a
+ * torn write at a crash is seen and dropped.
+ */
+struct journal_rec {
+	uint32_t crc;
+	uint32_t seq;
+	int64_t time_ns;	/* CLOCK_REALTIME */
+	uint8_t sym;		/* asked */
+	int8_t answer;		/* symbol typed, or -1 */
+	uint8_t key;		/* last byte typed */
+	uint8_t result;		/* JR_* */
+	float react_ms;
+	float weight;		/* after the answer */
+	float scale;		/* applied to the weight */
+};
+
+extern int journal_replay(void);
+extern int journal_start(void);
+extern void journal_append(struct journal_rec *rp);
+extern void journal_stop(void);
+
+#endif
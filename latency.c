@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2018 by Ross Wille. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * COPYING file for more details.
+ */
+
+/*
+ * How long queued symbols take to reach the DAC.
+ *
+ * Each symbol that starts in a rendered period is marked with
+ * its frame offset.  When the audio thread takes the period the
+ * mark gets an absolute output frame number, and once the sink
+ * reports how many frames it holds ahead of the DAC (and when),
+ * the mark's playout time follows from the sample rate.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "audio.h"
+#include "histo.h"
+#include "latency.h"
+
+#define LAT_PENDING		32
+#define NS_PER_MS		1.0e6
+
+struct lat_pending {
+	long long frame;	/* output frame number */
+	long long enq_ns;
+	long long key_ns;
+};
+
+struct latency_struct {
+	double sample_rate;
+	struct lat_slot slots[RING_SLOTS];
+	struct lat_pending pending[LAT_PENDING];	/* audio thread only */
+	int n_pending;
+	unsigned int dropped;
+	struct histo_struct enq_histo;
+	struct histo_struct key_histo;
+};
+
+static struct latency_struct lat;
+
+void latency_init(double sample_rate)
+{
+	memset(&lat, 0, sizeof(lat));
+	lat.sample_rate = sample_rate;
+	histo_init(&lat.enq_histo, "enqueue->DAC");
+	histo_init(&lat.key_histo, "keypress->DAC");
+}
+
+struct lat_slot *latency_slot(int slot)
+{
+	return &lat.slots[slot];
+}
+
+/*
+ * Audio thread: slot's first frame is output frame out_frame
+ */
+void latency_start(int slot, long long out_frame)
+{
+	struct lat_slot *ls = &lat.slots[slot];
+	struct lat_pending *lp;
+	int i;
+
+	for (i = 0; i < ls->n; i++) {
+		if (lat.n_pending == LAT_PENDING) {
+			lat.dropped++;
+			continue;
+		}
+		lp = &lat.pending[lat.n_pending++];
+		lp->frame = out_frame + ls->marks[i].frame;
+		lp->enq_ns = ls->marks[i].enq_ns;
+		lp->key_ns = ls->marks[i].key_ns;
+	}
+	ls->n = 0;
+}
+
+/*
+ * Audio thread: at ts_ns the sink had been given out_frames
+ * frames, of which delay were still queued ahead of the DAC.
+ */
+void latency_played(long long out_frames, long delay, long long ts_ns)
+{
+	struct lat_pending *lp;
+	long long dac_ns;
+	int i;
+
+	for (i = 0; i < lat.n_pending; ) {
+		lp = &lat.pending[i];
+		if (lp->frame >= out_frames) {
+			i++;
+			continue;
+		}
+		dac_ns = ts_ns + (lp->frame - (out_frames - delay)) * 1.0e9 / lat.sample_rate;
+		histo_add(&lat.enq_histo, dac_ns - lp->enq_ns);
+		if (lp->key_ns)
+			histo_add(&lat.key_histo, dac_ns - lp->key_ns);
+		*lp = lat.pending[--lat.n_pending];
+	}
+}
+
+/*
+ * Safe to call while the audio thread runs; the figures may
+ * then be a sample or two out of step with each other.
+ */
+void latency_report(FILE *fp)
+{
+	fprintf(fp, "latency:\r\n");
+	histo_print(&lat.enq_histo, fp, NS_PER_MS, "ms");
+	histo_print(&lat.key_histo, fp, NS_PER_MS, "ms");
+	if (lat.dropped)
+		fprintf(fp, "%20s: %u marks\r\n", "dropped", lat.dropped);
+}
@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2018 by Ross Wille. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * COPYING file for more details.
+ */
+
+#ifndef _LATENCY_H_
+#define _LATENCY_H_
+
+#include <stdio.h>
+
+#include "sym-queue.h"
+
+#define LAT_MARKS		4	/* symbol starts noted per period */
+
+/*
+ * Marks for one render-ahead ring slot.  The render thread
+ * fills it before publishing the slot, the audio thread reads
+ * it after taking the slot, so the ring orders the accesses.
+ */
+struct lat_slot {
+	int n;
+	struct sq_mark marks[LAT_MARKS];
+};
+
+extern void latency_init(double sample_rate);
+extern struct lat_slot *latency_slot(int slot);
+extern void latency_start(int slot, long long out_frame);
+extern void latency_played(long long out_frames, long delay, long long ts_ns);
+extern void latency_report(FILE *fp);
+
+#endif
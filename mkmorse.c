@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2018 by Ross Wille. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * COPYING file for more details.
+ */
+
+/*
+ * Build-time generator for the Morse table.
+ *
+ * Reads morse.def and writes C for cw[], with each code packed
+ * as a length and a bit mask (bit i set when element i is a
+ * DAH), the 256-entry index from an input byte to its symbol,
+ * and the list of prosigns.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "morse.h"
+
+#define MAX_ELEMENTS	8		/* the mask is a byte */
+#define MAX_NAME	8
+
+struct def_struct {
+	char name[MAX_NAME + 1];
+	char code[MAX_ELEMENTS + 1];
+	int len;
+	int bits;
+};
+
+static struct def_struct defs[MAX_SYMBOLS];
+static int n_defs;
+
+static int parse_line(const char *fn, int lineno, char *line)
+{
+	struct def_struct *dp;
+	char *name;
+	char *code;
+	int i;
+
+	name = strtok(line, " \t\r\n");
+	if ((name == NULL) || (name[0] == '#'))
+		return 0;
+	code = strtok(NULL, " \t\r\n");
+	if (code == NULL) {
+		fprintf(stderr, "%s:%d: no code for %s\n", fn, lineno, name);
+		return -1;
+	}
+	if (n_defs >= MAX_SYMBOLS) {
+		fprintf(stderr, "%s:%d: too many symbols\n", fn, lineno);
+		return -1;
+	}
+
+	dp = &defs[n_defs];
+	if ((strlen(name) > MAX_NAME) || (strlen(code) > MAX_ELEMENTS)) {
+		fprintf(stderr, "%s:%d: %s is too long\n", fn, lineno, name);
+		return -1;
+	}
+	if ((name[1] != '\0') &&
+	    ((name[0] != '<') || (name[strlen(name) - 1] != '>') || (strlen(name) < 4))) {
+		fprintf(stderr, "%s:%d: %s is neither a character nor a <prosign>\n",
+			fn, lineno, name);
+		return -1;
+	}
+	for (i = 0; name[i]; i++)
+		name[i] = toupper((unsigned char)name[i]);
+	strcpy(dp->name, name);
+	strcpy(dp->code, code);
+
+	dp->len = strlen(code);
+	dp->bits = 0;
+	for (i = 0; i < dp->len; i++) {
+		if (code[i] == '-')
+			dp->bits |= 1 << i;
+		else if (code[i] != '.') {
+			fprintf(stderr, "%s:%d: bad code %s\n", fn, lineno, code);
+			return -1;
+		}
+	}
+
+	for (i = 0; i < n_defs; i++) {
+		if (strcmp(defs[i].name, dp->name) == 0) {
+			fprintf(stderr, "%s:%d: %s is defined twice\n", fn, lineno, name);
+			return -1;
+		}
+		if ((defs[i].len == dp->len) && (defs[i].bits == dp->bits))
+			fprintf(stderr, "%s:%d: warning: %s has the same code as %s\n",
+				fn, lineno, name, defs[i].name);
+	}
+	n_defs++;
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	signed char index[256];
+	char line[128];
+	FILE *fp;
+	int lineno;
+	int c;
+	int i;
+
+	if (argc != 2) {
+		fprintf(stderr, "usage: mkmorse morse.def > morse-table.c\n");
+		return 1;
+	}
+	fp = fopen(argv[1], "r");
+	if (fp == NULL) {
+		perror(argv[1]);
+		return 1;
+	}
+	lineno = 0;
+	while (fgets(line, sizeof(line), fp)) {
+		if (parse_line(argv[1], ++lineno, line) < 0)
+			return 1;
+	}
+	fclose(fp);
+
+	memset(index, -1, sizeof(index));
+	for (i = 0; i < n_defs; i++) {
+		if (defs[i].name[1] != '\0')
+			continue;
+		c = (unsigned char)defs[i].name[0];
+		index[c] = i;
+		index[tolower(c)] = i;
+	}
+
+	printf("/* Generated by mkmorse from %s; do not edit. */\n\n", argv[1]);
+	printf("#include \"morse.h\"\n\n");
+
+	printf("struct cw_struct cw[] = {\n");
+	for (i = 0; i < n_defs; i++)
+		printf("\t{\"%s\",\t%d,\t0x%02x,\t1.0},\t/* %s */\n",
+			defs[i].name, defs[i].len, defs[i].bits, defs[i].code);
+	printf("};\n\n");
+	printf("const int n_cw = %d;\n\n", n_defs);
+
+	printf("const signed char cw_index[256] = {");
+	for (c = 0; c < 256; c++)
+		printf("%s%d,", (c % 16) ? " " : "\n\t", index[c]);
+	printf("\n};\n\n");
+
+	printf("const unsigned char cw_prosigns[] = {");
+	c = 0;
+	for (i = 0; i < n_defs; i++) {
+		if (defs[i].name[1] != '\0')
+			printf("%s%d", c++ ? ", " : "", i);
+	}
+	printf("};\n\n");
+	printf("const int n_prosigns = sizeof(cw_prosigns);\n");
+
+	return 0;
+}
@@ -12,6 +12,9 @@
  * COPYING file for more details.
  */
 
+#include <string.h>
+#include <strings.h>
+
 #include "morse.h"
 
 /*
@@ -31,50 +34,65 @@
  * Unit(ms) = 1200 / Speed(wpm)
  */
 
-struct cw_struct cw[] = {
-	{"A",	".-",		1.0},
-	{"B",	"-...",		1.0},
-	{"C",	"-.-.",		1.0},
-	{"D",	"-..",		1.0},
-	{"E",	".",		1.0},
-	{"F",	"..-.",		1.0},
-	{"G",	"--.",		1.0},
-	{"H",	"....",		1.0},
-	{"I",	"..",		1.0},
-	{"J",	".---",		1.0},
-	{"K",	"-.-",		1.0},
-	{"L",	".-..",		1.0},
-	{"M",	"--",		1.0},
-	{"N",	"-.",		1.0},
-	{"O",	"---",		1.0},
-	{"P",	".--.",		1.0},
-	{"Q",	"--.-",		1.0},
-	{"R",	".-.",		1.0},
-	{"S",	"...",		1.0},
-	{"T",	"-",		1.0},
-	{"U",	"..-",		1.0},
-	{"V",	"...-",		1.0},
-	{"W",	".--",		1.0},
-	{"X",	"-..-",		1.0},
-	{"Y",	"-.--",		1.0},
-	{"Z",	"--..",		1.0},
-	{"1",	".----",	1.0},
-	{"2",	"..---",	1.0},
-	{"3",	"...--",	1.0},
-	{"4",	"....-",	1.0},
-	{"5",	"....",		1.0},
-	{"6",	"-....",	1.0},
-	{"7",	"--...",	1.0},
-	{"8",	"---..",	1.0},
-	{"9",	"----.",	1.0},
-	{"0",	"-----",	1.0},
-	{"-",	"-...-",	1.0},
-	{".",	".-.-.-",	1.0},
-	{",",	"--..--",	1.0},
-	{"/",	"-..-.",	1.0},
-	{"?",	"..--..",	1.0},
-	{"AR",	".-.-.",	1.0},
-	{"SK",	"...-.-",	1.0},
-};
+/*
+ * The prosign spelled by letters[0..len), CW_PARTIAL if they
+ * only begin one, or -1
+ */
+int cw_prosign(const char *letters, int len)
+{
+	const char *name;
+	int partial = 0;
+	int i;
+
+	for (i = 0; i < n_prosigns; i++) {
+		name = cw[cw_prosigns[i]].symbol + 1;
+		if (strncasecmp(name, letters, len) != 0)
+			continue;
+		if (name[len] == '>')
+			return cw_prosigns[i];
+		partial = 1;
+	}
+	return partial ? CW_PARTIAL : -1;
+}
+
+/*
+ * The symbol named in a config file: a character, or a
+ * prosign with or without its brackets
+ */
+int cw_find(const char *name)
+{
+	int sym;
+	int len;
+
+	len = strlen(name);
+	if (len == 1)
+		return cw_lookup(name[0]);
+	if ((len > 2) && (name[0] == '<') && (name[len - 1] == '>')) {
+		name++;
+		len -= 2;
+	}
+	sym = cw_prosign(name, len);
+	return (sym >= 0) ? sym : -1;
+}
+
+/*
+ * The symbol at *pp, which is advanced past it: a character,
+ * or a prosign written as <AR>.  Returns -1, still advancing,
+ * for anything that cannot be sent.
+ */
+int cw_next(const char **pp)
+{
+	const char *p = *pp;
+	const char *end;
+	int sym;
 
-const int n_cw = sizeof(cw) / sizeof(cw[0]);
+	if ((*p == '<') && ((end = strchr(p, '>')) != NULL)) {
+		sym = cw_prosign(p + 1, end - (p + 1));
+		if (sym >= 0) {
+			*pp = end + 1;
+			return sym;
+		}
+	}
+	*pp = p + 1;
+	return cw_lookup(*p);
+}
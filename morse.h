@@ -17,13 +17,36 @@
 
 #define UNIT_MS_FROM_WPM(_wpm)	(1200.0 / (_wpm))
 
+/*
+ * The table is generated from morse.def by mkmorse.  Element i
+ * of a symbol is a DAH if bit i of bits is set.
+ */
 struct cw_struct {
-	char *symbol;
-	char *cw;
+	char *symbol;		/* character, or <prosign> */
+	unsigned char len;	/* elements */
+	unsigned char bits;
 	float weight;
 };
 
+#define CW_PARTIAL		(-2)	/* a prosign prefix */
+#define MAX_SYMBOLS		127	/* cw_index[] holds a signed char */
+
 extern struct cw_struct cw[];
 extern const int n_cw;
+extern const signed char cw_index[256];
+extern const unsigned char cw_prosigns[];
+extern const int n_prosigns;
+
+/*
+ * The symbol for input byte c, or -1
+ */
+static inline int cw_lookup(int c)
+{
+	return cw_index[c & 0xff];
+}
+
+extern int cw_prosign(const char *letters, int len);
+extern int cw_find(const char *name);
+extern int cw_next(const char **pp);
 
 #endif
@@ -0,0 +1,310 @@
+/*
+ * Copyright (C) 2018 by Ross Wille. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * COPYING file for more details.
+ */
+
+/*
+ * Float to sink format conversion.
+ *
+ * The integer formats are rounded to nearest after adding
+ * triangular (TPDF) dither of +/-1 LSB, which turns the
+ * quantization error into a constant, signal-independent
+ * noise floor: a slow keying envelope fading out no longer
+ * leaves a trail of harmonic distortion.  S32 is not dithered
+ * since float already holds less than 32 bits.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+
+#include "pcm.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define PCM_KERNEL	__attribute__((target_clones("avx2", "default")))
+#else
+#define PCM_KERNEL
+#endif
+
+typedef float v8sf __attribute__((vector_size(PCM_LANES * sizeof(float))));
+typedef int v8si __attribute__((vector_size(PCM_LANES * sizeof(int))));
+typedef unsigned int v8su __attribute__((vector_size(PCM_LANES * sizeof(int))));
+typedef short v8hi __attribute__((vector_size(PCM_LANES * sizeof(short))));
+
+static const char *format_names[N_PCM_FORMATS] = {
+	[PCM_S16] = "S16_LE",
+	[PCM_S24_3] = "S24_3LE",
+	[PCM_S32] = "S32_LE",
+	[PCM_FLOAT] = "FLOAT_LE",
+};
+
+/*
+ * Accepts the ALSA names, with or without "_LE"
+ */
+int pcm_format_lookup(const char *name)
+{
+	size_t len;
+	int i;
+
+	len = strlen(name);
+	for (i = 0; i < N_PCM_FORMATS; i++) {
+		if ((strncasecmp(name, format_names[i], len) == 0) &&
+		    ((format_names[i][len] == '\0') || (strcasecmp(&format_names[i][len], "_LE") == 0)))
+			return i;
+	}
+	return -1;
+}
+
+const char *pcm_format_name(int format)
+{
+	if ((format < 0) || (format >= N_PCM_FORMATS))
+		return "?";
+	return format_names[format];
+}
+
+void pcm_dither_init(struct pcm_dither *dp, unsigned int seed)
+{
+	unsigned int x;
+	int i;
+
+	/* xorshift32 must not start at zero */
+	x = seed ? seed : 0x9e3779b9;
+	for (i = 0; i < PCM_LANES; i++) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		dp->state[i] = x;
+	}
+}
+
+/*
+ * The helpers take pointers: passing 32-byte vectors by value
+ * is ABI-dependent.
+ */
+static inline void xorshift(v8su *x)
+{
+	*x ^= *x << 13;
+	*x ^= *x >> 17;
+	*x ^= *x << 5;
+}
+
+/*
+ * Triangular noise in (-1, 1) LSB: the difference of two
+ * uniform variables
+ */
+static inline void tpdf(v8sf *d, v8su *sp)
+{
+	const v8sf scale = (v8sf){0} + 1.0f / 16777216.0f;
+	v8sf a;
+
+	xorshift(sp);
+	a = __builtin_convertvector((v8si)(*sp >> 8), v8sf);
+	xorshift(sp);
+	*d = (a - __builtin_convertvector((v8si)(*sp >> 8), v8sf)) * scale;
+}
+
+static inline void clamp(v8sf *x, float lo, float hi)
+{
+	const v8sf vlo = (v8sf){0} + lo;
+	const v8sf vhi = (v8sf){0} + hi;
+	v8si m;
+
+	m = *x < vlo;
+	*x = (v8sf)((m & (v8si)vlo) | (~m & (v8si)*x));
+	m = *x > vhi;
+	*x = (v8sf)((m & (v8si)vhi) | (~m & (v8si)*x));
+}
+
+/*
+ * Scale, dither, clamp and round to nearest.  The conversion
+ * truncates, so the remainder is used to step away from zero.
+ */
+static inline void quantize(v8si *r, const v8sf *in, float scale, v8su *sp)
+{
+	const v8sf half = (v8sf){0} + 0.5f;
+	v8sf frac;
+	v8sf d;
+	v8sf x;
+
+	tpdf(&d, sp);
+	x = *in * scale + d;
+	clamp(&x, -scale, scale - 1.0f);
+	*r = __builtin_convertvector(x, v8si);
+	frac = x - __builtin_convertvector(*r, v8sf);
+	/* true lanes are -1 */
+	*r -= (frac >= half);
+	*r += (frac <= -half);
+}
+
+PCM_KERNEL
+static void to_s16(short *out, const float *in, int n, struct pcm_dither *dp)
+{
+	v8su s;
+	v8sf x;
+	v8si v;
+	v8hi h;
+	int i;
+
+	memcpy(&s, dp->state, sizeof(s));
+	for (i = 0; i + PCM_LANES <= n; i += PCM_LANES) {
+		memcpy(&x, &in[i], sizeof(x));
+		quantize(&v, &x, 32768.0f, &s);
+		h = __builtin_convertvector(v, v8hi);
+		memcpy(&out[i], &h, sizeof(h));
+	}
+	if (i < n) {
+		x = (v8sf){0};
+		memcpy(&x, &in[i], (n - i) * sizeof(float));
+		quantize(&v, &x, 32768.0f, &s);
+		h = __builtin_convertvector(v, v8hi);
+		memcpy(&out[i], &h, (n - i) * sizeof(short));
+	}
+	memcpy(dp->state, &s, sizeof(s));
+}
+
+PCM_KERNEL
+static void to_s24_3(unsigned char *out, const float *in, int n, struct pcm_dither *dp)
+{
+	v8su s;
+	v8sf x;
+	v8si v;
+	int i;
+	int k;
+
+	memcpy(&s, dp->state, sizeof(s));
+	for (i = 0; i < n; i += PCM_LANES) {
+		x = (v8sf){0};
+		memcpy(&x, &in[i], ((n - i < PCM_LANES) ? n - i : PCM_LANES) * sizeof(float));
+		quantize(&v, &x, 8388608.0f, &s);
+		for (k = 0; (k < PCM_LANES) && (i + k < n); k++) {
+			*out++ = v[k];
+			*out++ = v[k] >> 8;
+			*out++ = v[k] >> 16;
+		}
+	}
+	memcpy(dp->state, &s, sizeof(s));
+}
+
+PCM_KERNEL
+static void to_s32(int *out, const float *in, int n)
+{
+	v8sf x;
+	v8si v;
+	int i;
+
+	for (i = 0; i + PCM_LANES <= n; i += PCM_LANES) {
+		memcpy(&x, &in[i], sizeof(x));
+		/* 2^31 - 128 is the largest float below 2^31 */
+		x *= 2147483648.0f;
+		clamp(&x, -2147483648.0f, 2147483520.0f);
+		v = __builtin_convertvector(x, v8si);
+		memcpy(&out[i], &v, sizeof(v));
+	}
+	for (; i < n; i++) {
+		float y = in[i] * 2147483648.0f;
+
+		out[i] = (y < -2147483648.0f) ? INT32_MIN : (y > 2147483520.0f) ? 2147483520 : (int)y;
+	}
+}
+
+/*
+ * Convert samples (not frames) of float to format.  The
+ * dither state carries across calls; keep one per stream.
+ */
+void pcm_convert(void *out, const float *in, int samples, int format,
+	struct pcm_dither *dp)
+{
+	switch (format) {
+	case PCM_S16:
+		to_s16(out, in, samples, dp);
+		break;
+	case PCM_S24_3:
+		to_s24_3(out, in, samples, dp);
+		break;
+	case PCM_S32:
+		to_s32(out, in, samples);
+		break;
+	case PCM_FLOAT:
+	default:
+		memcpy(out, in, samples * sizeof(float));
+		break;
+	}
+}
+
+#ifdef MAIN
+#include <math.h>
+#include <time.h>
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1.0e9;
+}
+
+int main(int argc, char *argv[])
+{
+	struct pcm_dither dither;
+	unsigned char *out;
+	short *s16;
+	float *in;
+	double sum;
+	double sum2;
+	double err;
+	double t;
+	int samples;
+	int reps;
+	int fmt;
+	int i;
+	int r;
+
+	samples = 48000 * 2;
+	reps = (argc > 1) ? atoi(argv[1]) : 200;
+
+	in = malloc(samples * sizeof(float));
+	out = malloc(samples * 4);
+	for (i = 0; i < samples; i++)
+		in[i] = 0.5 * sin(2.0 * M_PI * 1000.0 * i / 48000.0);
+
+	printf("%d samples x %d\n", samples, reps);
+	for (fmt = 0; fmt < N_PCM_FORMATS; fmt++) {
+		pcm_dither_init(&dither, 1);
+		t = now();
+		for (r = 0; r < reps; r++)
+			pcm_convert(out, in, samples, fmt, &dither);
+		t = now() - t;
+		printf("  %8s: %8.2f Msamples/s\n", pcm_format_name(fmt),
+			(double)samples * reps / t / 1.0e6);
+	}
+
+	/* TPDF: no bias, and 0.5 LSB rms of rounding plus dither */
+	pcm_dither_init(&dither, 1);
+	pcm_convert(out, in, samples, PCM_S16, &dither);
+	s16 = (short *)out;
+	sum = sum2 = 0.0;
+	for (i = 0; i < samples; i++) {
+		err = s16[i] - in[i] * 32768.0;
+		sum += err;
+		sum2 += err * err;
+	}
+	printf("  S16 error: mean %+0.4f LSB, rms %0.4f LSB (expect 0, 0.5)\n",
+		sum / samples, sqrt(sum2 / samples));
+
+	free(in);
+	free(out);
+
+	return 0;
+}
+#endif
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2018 by Ross Wille. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * COPYING file for more details.
+ */
+
+#ifndef _PCM_H_
+#define _PCM_H_
+
+/*
+ * Sample formats a sink can take.  Everything upstream of
+ * the sink is float, full scale +/-1.0, and is converted to
+ * the sink's format as the last step of rendering a period.
+ */
+#define PCM_S16			0	/* S16_LE */
+#define PCM_S24_3		1	/* S24_3LE, packed */
+#define PCM_S32			2	/* S32_LE */
+#define PCM_FLOAT		3	/* FLOAT_LE */
+#define N_PCM_FORMATS		4
+
+#define PCM_LANES		8
+
+/*
+ * TPDF dither state: one xorshift32 generator per lane
+ */
+struct pcm_dither {
+	unsigned int state[PCM_LANES];
+};
+
+static inline int pcm_sample_size(int format)
+{
+	static const int sizes[N_PCM_FORMATS] = {2, 3, 4, 4};
+
+	return sizes[format];
+}
+
+extern int pcm_format_lookup(const char *name);
+extern const char *pcm_format_name(int format);
+extern void pcm_dither_init(struct pcm_dither *dp, unsigned int seed);
+extern void pcm_convert(void *out, const float *in, int samples, int format,
+	struct pcm_dither *dp);
+
+#endif
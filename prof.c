@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2018 by Ross Wille. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * COPYING file for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "config.h"
+#include "histo.h"
+#include "prof.h"
+
+/*
+ * Room for about 20 minutes of trace; recording stops when
+ * it is full.  Allocated up front so that the audio thread
+ * never allocates.
+ */
+#define PROF_MAX_EVENTS		(1 << 19)
+#define NS_PER_US		1000.0
+
+#define TID_RENDER		1
+#define TID_AUDIO		2
+
+struct prof_event {
+	int id;
+	long long start_ns;
+	long long dur_ns;
+};
+
+struct prof_struct {
+	struct histo_struct histo[PROF_N];	/* each written by one thread */
+	long long start_ns;
+	const char *trace_fn;
+	struct prof_event *trace;
+	atomic_int n_events;
+};
+
+static const struct {
+	const char *name;
+	int tid;
+} prof_ids[PROF_N] = {
+	[PROF_GET_PERIOD] = {"get_period", TID_RENDER},
+	[PROF_SQ_LOCK] = {"sq.lock wait", TID_RENDER},
+	[PROF_PCM_WRITE] = {"pcm write", TID_AUDIO},
+	[PROF_WAKE] = {"wake jitter", TID_AUDIO},
+};
+
+static struct prof_struct prof;
+
+long long prof_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*
+ * Also keep a timeline of every event, for chrome://tracing or
+ * Perfetto, if trace_fn is given.
+ */
+int prof_init(const char *trace_fn)
+{
+	int i;
+
+	memset(&prof, 0, sizeof(prof));
+	for (i = 0; i < PROF_N; i++)
+		histo_init(&prof.histo[i], prof_ids[i].name);
+	prof.start_ns = prof_now();
+	atomic_init(&prof.n_events, 0);
+
+	if (trace_fn == NULL)
+		return 0;
+	prof.trace = malloc(PROF_MAX_EVENTS * sizeof(struct prof_event));
+	if (prof.trace == NULL)
+		return -1;
+	prof.trace_fn = trace_fn;
+
+	return 0;
+}
+
+void prof_add(int id, long long start_ns, long long dur_ns)
+{
+	int i;
+
+	histo_add(&prof.histo[id], dur_ns);
+	if (prof.trace == NULL)
+		return;
+
+	i = atomic_fetch_add_explicit(&prof.n_events, 1, memory_order_relaxed);
+	if (i < PROF_MAX_EVENTS) {
+		prof.trace[i].id = id;
+		prof.trace[i].start_ns = start_ns;
+		prof.trace[i].dur_ns = dur_ns;
+	}
+}
+
+void prof_print(FILE *fp)
+{
+	int i;
+
+	fprintf(fp, "  period profile:\r\n");
+	for (i = 0; i < PROF_N; i++)
+		histo_print(&prof.histo[i], fp, NS_PER_US, "us");
+}
+
+/*
+ * Chrome trace-event JSON: one complete ("X") event per
+ * profiled interval, in microseconds from prof_init().
+ */
+static int prof_write_trace(void)
+{
+	FILE *fp;
+	int n;
+	int i;
+
+	fp = fopen(prof.trace_fn, "w");
+	if (fp == NULL)
+		return -1;
+
+	fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(fp, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+		"\"args\":{\"name\":\"render\"}},\n", TID_RENDER);
+	fprintf(fp, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+		"\"args\":{\"name\":\"audio\"}}", TID_AUDIO);
+
+	n = atomic_load(&prof.n_events);
+	if (n > PROF_MAX_EVENTS) {
+		fprintf(stderr, "trace: kept the first %d of %d events\r\n", PROF_MAX_EVENTS, n);
+		n = PROF_MAX_EVENTS;
+	}
+	for (i = 0; i < n; i++) {
+		struct prof_event *ep = &prof.trace[i];
+
+		fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+			"\"ts\":%0.3f,\"dur\":%0.3f}",
+			prof_ids[ep->id].name, prof_ids[ep->id].tid,
+			(ep->start_ns - prof.start_ns) / NS_PER_US, ep->dur_ns / NS_PER_US);
+	}
+	fprintf(fp, "\n]}\n");
+
+	return fclose(fp);
+}
+
+/*
+ * Once the profiled threads have stopped
+ */
+void prof_fini(void)
+{
+	if (prof.trace == NULL)
+		return;
+	if (prof_write_trace() < 0)
+		perror(prof.trace_fn);
+	free(prof.trace);
+	prof.trace = NULL;
+}
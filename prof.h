@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2018 by Ross Wille. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * COPYING file for more details.
+ */
+
+#ifndef _PROF_H_
+#define _PROF_H_
+
+#include <stdio.h>
+
+#include "config.h"
+
+/*
+ * Per-period profile of the render and audio threads
+ */
+#define PROF_GET_PERIOD		0	/* render: get_period() */
+#define PROF_SQ_LOCK		1	/* render: waiting for sq.lock */
+#define PROF_PCM_WRITE		2	/* audio: handing a period to the sink */
+#define PROF_WAKE		3	/* audio: wake-up vs. the period deadline */
+#define PROF_N			4
+
+#ifdef QUEUE_STATS
+#define PROF_START(_v)		long long _v = prof_now()
+#define PROF_STOP(_id, _v)	prof_add(_id, _v, prof_now() - (_v))
+#else
+#define PROF_START(_v)		do {} while (0)
+#define PROF_STOP(_id, _v)	do {} while (0)
+#endif
+
+extern int prof_init(const char *trace_fn);
+extern void prof_fini(void);
+extern long long prof_now(void);
+extern void prof_add(int id, long long start_ns, long long dur_ns);
+extern void prof_print(FILE *fp);
+
+#endif
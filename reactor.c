@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2018 by Ross Wille. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * COPYING file for more details.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <errno.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+
+#include "reactor.h"
+
+int reactor_create(struct reactor_struct *rp)
+{
+	memset(rp, 0, sizeof(*rp));
+	rp->stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (rp->stop_fd < 0)
+		return -1;
+	rp->fds[0].fd = rp->stop_fd;
+	rp->fds[0].events = POLLIN;
+	rp->n_fds = 1;
+
+	return 0;
+}
+
+void reactor_destroy(struct reactor_struct *rp)
+{
+	int i;
+
+	for (i = 1; i < rp->n_fds; i++) {
+		if (rp->handlers[i].owned)
+			close(rp->fds[i].fd);
+	}
+	close(rp->stop_fd);
+	rp->n_fds = 0;
+}
+
+int reactor_add(struct reactor_struct *rp, int fd, short events,
+	reactor_fn fn, void *cookie)
+{
+	int i;
+
+	if ((fd < 0) || (rp->n_fds == REACTOR_MAX_FDS))
+		return -1;
+
+	i = rp->n_fds++;
+	rp->fds[i].fd = fd;
+	rp->fds[i].events = events;
+	rp->fds[i].revents = 0;
+	rp->handlers[i].fn = fn;
+	rp->handlers[i].cookie = cookie;
+	rp->handlers[i].owned = 0;
+
+	return 0;
+}
+
+static int reactor_add_owned(struct reactor_struct *rp, int fd,
+	reactor_fn fn, void *cookie)
+{
+	if (reactor_add(rp, fd, POLLIN, fn, cookie) < 0) {
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+	rp->handlers[rp->n_fds - 1].owned = 1;
+
+	return fd;
+}
+
+/*
+ * Deliver sigs through a signalfd instead of asynchronously.
+ * They are blocked in the calling thread, so call this before
+ * starting any other thread and they will inherit the mask.
+ */
+int reactor_signals(struct reactor_struct *rp, const int *sigs, int n_sigs,
+	reactor_fn fn, void *cookie)
+{
+	sigset_t mask;
+	int i;
+
+	sigemptyset(&mask);
+	for (i = 0; i < n_sigs; i++)
+		sigaddset(&mask, sigs[i]);
+	if (pthread_sigmask(SIG_BLOCK, &mask, NULL) != 0)
+		return -1;
+
+	return reactor_add_owned(rp, signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK),
+		fn, cookie);
+}
+
+/*
+ * Dispatch events until reactor_stop().  Returns -1 if
+ * poll() fails.
+ */
+int reactor_run(struct reactor_struct *rp)
+{
+	int rc;
+	int i;
+
+	rp->running = 1;
+	while (rp->running) {
+		rc = poll(rp->fds, rp->n_fds, -1);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		rp->wakeups++;
+
+		if (rp->fds[0].revents) {
+			reactor_drain(rp->stop_fd);
+			break;
+		}
+		for (i = 1; (i < rp->n_fds) && rp->running; i++) {
+			if (rp->fds[i].revents)
+				rp->handlers[i].fn(rp, rp->fds[i].fd, rp->handlers[i].cookie);
+		}
+	}
+	rp->running = 0;
+
+	return 0;
+}
+
+/*
+ * Safe from any thread, and from the reactor's own handlers
+ */
+void reactor_stop(struct reactor_struct *rp)
+{
+	uint64_t one = 1;
+
+	if (write(rp->stop_fd, &one, sizeof(one)) < 0)
+		perror("reactor_stop");
+}
+
+/*
+ * Read and reset an eventfd counter
+ */
+unsigned long long reactor_drain(int fd)
+{
+	uint64_t n;
+
+	if (read(fd, &n, sizeof(n)) != sizeof(n))
+		return 0;
+	return n;
+}
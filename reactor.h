@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2018 by Ross Wille. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * COPYING file for more details.
+ */
+
+#ifndef _REACTOR_H_
+#define _REACTOR_H_
+
+#include <poll.h>
+
+#define REACTOR_MAX_FDS		16
+
+struct reactor_struct;
+
+/*
+ * Called when fd is ready.  The handler must consume the event
+ * (read the tty, the eventfd count, the signalfd siginfo, ...)
+ * or it will be called again straight away.
+ */
+typedef void (*reactor_fn)(struct reactor_struct *rp, int fd, void *cookie);
+
+struct reactor_handler {
+	reactor_fn fn;
+	void *cookie;
+	int owned;		/* fd created by the reactor */
+};
+
+/*
+ * A poll(2) loop: one thread sleeps until one of its
+ * descriptors is ready and runs the matching handler.
+ */
+struct reactor_struct {
+	struct pollfd fds[REACTOR_MAX_FDS];
+	struct reactor_handler handlers[REACTOR_MAX_FDS];
+	int n_fds;
+	int stop_fd;		/* eventfd, written by reactor_stop() */
+	int running;
+	unsigned long wakeups;
+};
+
+extern int reactor_create(struct reactor_struct *rp);
+extern void reactor_destroy(struct reactor_struct *rp);
+extern int reactor_add(struct reactor_struct *rp, int fd, short events,
+	reactor_fn fn, void *cookie);
+extern int reactor_signals(struct reactor_struct *rp, const int *sigs, int n_sigs,
+	reactor_fn fn, void *cookie);
+extern int reactor_run(struct reactor_struct *rp);
+extern void reactor_stop(struct reactor_struct *rp);
+extern unsigned long long reactor_drain(int fd);
+
+#endif
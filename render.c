@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2018 by Ross Wille. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * COPYING file for more details.
+ */
+
+/*
+ * Offline session renderer.
+ *
+ * Drives the same symbol_chooser(), symbol queue and get_period()
+ * path as a live session, without an audio device or pacing, and
+ * writes the drill to a WAV file as fast as the CPU allows.  The
+ * answer key is printed on stdout.  For a given seed, weights and
+ * settings the output is byte-identical.
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#include "config.h"
+#include "alsa.h"
+#include "dict.h"
+#include "morse.h"
+#include "symbols.h"
+#include "sym-queue.h"
+#include "render.h"
+#include "wav.h"
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1.0e9;
+}
+
+int render_session(const char *fn, int count)
+{
+	static float mix[FRAMES_PER_PERIOD * MAX_CHANNELS];
+	static unsigned char buf[FRAMES_PER_PERIOD * MAX_FRAME_SIZE];
+	struct pcm_dither dither;
+	struct wav_struct wav;
+	double frames;
+	double secs;
+	double t;
+	int sym;
+	int rc;
+	int i;
+
+	if (settings.format < 0)
+		settings.format = PCM_S16;
+	pcm_dither_init(&dither, 0);
+	if (wav_create(&wav, fn, settings.sample_rate, settings.n_chans, settings.format) < 0) {
+		fprintf(stderr, "cannot create %s\n", fn);
+		return -1;
+	}
+
+	t = now();
+	frames = 0;
+	rc = 0;
+	for (i = 0; (i < count) && (rc == 0); i++) {
+		/* each character or word is followed by a word space */
+		if (dictionary.n) {
+			sym = dict_chooser(&dictionary);
+			printf("%s\n", dict_entry(&dictionary, sym));
+			sq_put_text(dict_entry(&dictionary, sym), 0);
+		}
+		else {
+			sym = symbol_chooser();
+			printf("%s%s", cw[sym].symbol, ((i + 1) % 10) ? " " : "\n");
+			sq_put(&symbols.chars[sym]);
+		}
+		sq_put(&symbols.space);
+		while (sq_busy() && (rc == 0)) {
+			get_period(mix, FRAMES_PER_PERIOD);
+			pcm_convert(buf, mix, FRAMES_PER_PERIOD * settings.n_chans, settings.format,
+				&dither);
+			rc = wav_write(&wav, buf, FRAMES_PER_PERIOD);
+			frames += FRAMES_PER_PERIOD;
+		}
+	}
+	if ((i % 10) && !dictionary.n)
+		printf("\n");
+
+	if (wav_close(&wav) < 0)
+		rc = -1;
+	if (rc < 0) {
+		fprintf(stderr, "error writing %s\n", fn);
+		return -1;
+	}
+
+	t = now() - t;
+	secs = frames / settings.sample_rate;
+	fprintf(stderr, "%d %s, %0.1f s of audio in %0.3f s (%0.0fx realtime)\n",
+		count, dictionary.n ? "words" : "symbols", secs, t, secs / t);
+
+	return 0;
+}
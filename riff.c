@@ -0,0 +1,214 @@
+/*
+ * Copyright (C) 2018 by Ross Wille. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * COPYING file for more details.
+ */
+
+/*
+ * RIFF/WAVE reader.  The file is mapped and its chunks walked
+ * in place; anything but "fmt " and "data" (LIST, fact, cue,
+ * ...) is skipped.  8-bit unsigned, 16, 24 and 32-bit signed
+ * and 32 or 64-bit float samples are read, in any number of
+ * channels and at any rate.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "riff.h"
+
+#define FMT_MIN_SIZE		16
+#define FMT_EXT_SIZE		40	/* WAVE_FORMAT_EXTENSIBLE */
+
+static unsigned int get_le16(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static unsigned int get_le32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+static int riff_fmt(struct riff_struct *rp, const unsigned char *p, unsigned int len)
+{
+	if (len < FMT_MIN_SIZE)
+		return -1;
+
+	rp->tag = get_le16(&p[0]);
+	rp->n_chans = get_le16(&p[2]);
+	rp->rate = get_le32(&p[4]);
+	rp->block_align = get_le16(&p[12]);
+	rp->bits = get_le16(&p[14]);
+
+	/* the real tag is the first two bytes of the sub-format GUID */
+	if ((rp->tag == RIFF_EXTENSIBLE) && (len >= FMT_EXT_SIZE))
+		rp->tag = get_le16(&p[24]);
+
+	if ((rp->n_chans < 1) || (rp->rate < 1) ||
+	    (rp->block_align < rp->n_chans * ((rp->bits + 7) / 8)))
+		return -1;
+
+	switch (rp->tag) {
+	case RIFF_PCM:
+		if ((rp->bits == 8) || (rp->bits == 16) || (rp->bits == 24) || (rp->bits == 32))
+			return 0;
+		break;
+	case RIFF_FLOAT:
+		if ((rp->bits == 32) || (rp->bits == 64))
+			return 0;
+		break;
+	}
+	return -1;
+}
+
+/*
+ * Walk the chunks.  A data chunk that claims more than the file
+ * holds (a recording that was never closed) is cut to fit.
+ */
+static int riff_parse(struct riff_struct *rp)
+{
+	const unsigned char *p = rp->map;
+	const unsigned char *end = p + rp->map_len;
+	unsigned int len;
+	int have_fmt = 0;
+
+	if ((rp->map_len < 12) || memcmp(p, "RIFF", 4) || memcmp(p + 8, "WAVE", 4))
+		return -1;
+
+	for (p += 12; p + 8 <= end; p += 8 + len + (len & 1)) {
+		len = get_le32(p + 4);
+		if (len > end - (p + 8))
+			len = end - (p + 8);
+
+		if (memcmp(p, "fmt ", 4) == 0) {
+			if (riff_fmt(rp, p + 8, len) < 0)
+				return -1;
+			have_fmt = 1;
+		}
+		else if (memcmp(p, "data", 4) == 0) {
+			if (!have_fmt)
+				return -1;
+			rp->data = p + 8;
+			rp->frames = len / rp->block_align;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+int riff_open(struct riff_struct *rp, const char *fn)
+{
+	struct stat sb;
+	int fd;
+
+	memset(rp, 0, sizeof(*rp));
+
+	fd = open(fn, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		perror(fn);
+		return -1;
+	}
+	if (fstat(fd, &sb) < 0) {
+		perror(fn);
+		close(fd);
+		return -1;
+	}
+	rp->map_len = sb.st_size;
+	rp->map = mmap(NULL, rp->map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (rp->map == MAP_FAILED) {
+		perror(fn);
+		rp->map = NULL;
+		return -1;
+	}
+	madvise(rp->map, rp->map_len, MADV_SEQUENTIAL);
+
+	if (riff_parse(rp) < 0) {
+		fprintf(stderr, "%s: not a WAVE file this program can read\n", fn);
+		riff_close(rp);
+		return -1;
+	}
+	return 0;
+}
+
+static float riff_sample(const struct riff_struct *rp, const unsigned char *p)
+{
+	union {
+		uint32_t u;
+		float f;
+	} f32;
+	union {
+		uint64_t u;
+		double d;
+	} f64;
+
+	if (rp->tag == RIFF_FLOAT) {
+		if (rp->bits == 32) {
+			f32.u = get_le32(p);
+			return f32.f;
+		}
+		f64.u = get_le32(p) | ((uint64_t)get_le32(p + 4) << 32);
+		return f64.d;
+	}
+
+	switch (rp->bits) {
+	case 8:
+		return (p[0] - 128) / 128.0f;
+	case 16:
+		return (int16_t)get_le16(p) / 32768.0f;
+	case 24:
+		return ((int32_t)((p[0] << 8) | (p[1] << 16) | ((uint32_t)p[2] << 24)) >> 8) / 8388608.0f;
+	default:
+		return (int32_t)get_le32(p) / 2147483648.0f;
+	}
+}
+
+/*
+ * The whole file as float, the channels averaged to mono.
+ * The caller frees the result.
+ */
+float *riff_read_mono(const struct riff_struct *rp)
+{
+	const unsigned char *frame;
+	int size = (rp->bits + 7) / 8;
+	float *pcm;
+	float sum;
+	long i;
+	int c;
+
+	pcm = malloc((rp->frames ? rp->frames : 1) * sizeof(float));
+	if (pcm == NULL)
+		return NULL;
+
+	frame = rp->data;
+	for (i = 0; i < rp->frames; i++) {
+		sum = 0.0f;
+		for (c = 0; c < rp->n_chans; c++)
+			sum += riff_sample(rp, frame + c * size);
+		pcm[i] = sum / rp->n_chans;
+		frame += rp->block_align;
+	}
+	return pcm;
+}
+
+void riff_close(struct riff_struct *rp)
+{
+	if (rp->map)
+		munmap(rp->map, rp->map_len);
+	rp->map = NULL;
+}
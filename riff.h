@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2018 by Ross Wille. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * COPYING file for more details.
+ */
+
+#ifndef _RIFF_H_
+#define _RIFF_H_
+
+#include <stddef.h>
+
+/*
+ * A RIFF/WAVE file mapped read-only.  data points at the first
+ * frame of the "data" chunk inside the mapping.
+ */
+struct riff_struct {
+	void *map;
+	size_t map_len;
+	int tag;		/* RIFF_PCM or RIFF_FLOAT */
+	int n_chans;
+	int rate;
+	int bits;		/* container bits per sample */
+	int block_align;	/* bytes per frame */
+	const unsigned char *data;
+	long frames;
+};
+
+#define RIFF_PCM		0x0001
+#define RIFF_FLOAT		0x0003
+#define RIFF_EXTENSIBLE		0xfffe
+
+extern int riff_open(struct riff_struct *rp, const char *fn);
+extern float *riff_read_mono(const struct riff_struct *rp);
+extern void riff_close(struct riff_struct *rp);
+
+#endif
@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2018 by Ross Wille. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * COPYING file for more details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "ring.h"
+
+#define NS_PER_SEC		1000000000L
+
+/*
+ * head and tail count periods forever and are only reduced
+ * modulo the ring size when indexing, so level is tail - head
+ * even after they wrap.  That needs a power-of-two slot count.
+ */
+#define SLOT(_rp, _n)		((_rp)->buf + ((_n) % (_rp)->slots) * (_rp)->slot_size)
+
+int ring_create(struct ring_struct *rp, int slots, int slot_size, int depth)
+{
+	rp->buf = calloc(slots, slot_size);
+	if (rp->buf == NULL)
+		return -1;
+	rp->slot_size = slot_size;
+	rp->slots = slots;
+	atomic_init(&rp->depth, depth);
+	atomic_init(&rp->head, 0);
+	atomic_init(&rp->tail, 0);
+	sem_init(&rp->space, 0, 0);
+
+	return 0;
+}
+
+void ring_destroy(struct ring_struct *rp)
+{
+	sem_destroy(&rp->space);
+	free(rp->buf);
+	rp->buf = NULL;
+}
+
+/*
+ * Producer: the next free slot, or NULL if the ring
+ * already holds "depth" periods.
+ */
+unsigned char *ring_write_slot(struct ring_struct *rp)
+{
+	unsigned int head;
+	unsigned int tail;
+
+	tail = atomic_load_explicit(&rp->tail, memory_order_relaxed);
+	head = atomic_load_explicit(&rp->head, memory_order_acquire);
+	if ((int)(tail - head) >= atomic_load_explicit(&rp->depth, memory_order_relaxed))
+		return NULL;
+
+	return SLOT(rp, tail);
+}
+
+void ring_publish(struct ring_struct *rp)
+{
+	unsigned int tail;
+
+	tail = atomic_load_explicit(&rp->tail, memory_order_relaxed);
+	atomic_store_explicit(&rp->tail, tail + 1, memory_order_release);
+}
+
+/*
+ * Producer: sleep until the consumer frees a slot, or
+ * forever if timeout_ms is negative.  Returns nonzero on
+ * timeout.
+ */
+int ring_wait_space(struct ring_struct *rp, int timeout_ms)
+{
+	struct timespec ts;
+	int rc;
+
+	if (timeout_ms < 0) {
+		while ((rc = sem_wait(&rp->space)) != 0) {
+			if (errno != EINTR)
+				break;
+		}
+		return rc;
+	}
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_nsec += (long)timeout_ms * 1000000L;
+	while (ts.tv_nsec >= NS_PER_SEC) {
+		ts.tv_nsec -= NS_PER_SEC;
+		ts.tv_sec++;
+	}
+	while ((rc = sem_timedwait(&rp->space, &ts)) != 0) {
+		if (errno != EINTR)
+			break;
+	}
+	return rc;
+}
+
+/*
+ * Consumer: the oldest rendered period, or NULL if empty
+ */
+unsigned char *ring_read_slot(struct ring_struct *rp)
+{
+	unsigned int head;
+	unsigned int tail;
+
+	head = atomic_load_explicit(&rp->head, memory_order_relaxed);
+	tail = atomic_load_explicit(&rp->tail, memory_order_acquire);
+	if (head == tail)
+		return NULL;
+
+	return SLOT(rp, head);
+}
+
+void ring_release(struct ring_struct *rp)
+{
+	unsigned int head;
+
+	head = atomic_load_explicit(&rp->head, memory_order_relaxed);
+	atomic_store_explicit(&rp->head, head + 1, memory_order_release);
+	sem_post(&rp->space);
+}
+
+/*
+ * Wake a producer sleeping in ring_wait_space()
+ */
+void ring_kick(struct ring_struct *rp)
+{
+	sem_post(&rp->space);
+}
+
+int ring_level(struct ring_struct *rp)
+{
+	return atomic_load_explicit(&rp->tail, memory_order_acquire) -
+		atomic_load_explicit(&rp->head, memory_order_acquire);
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2018 by Ross Wille. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * COPYING file for more details.
+ */
+
+#ifndef _RING_H_
+#define _RING_H_
+
+#include <stdatomic.h>
+#include <semaphore.h>
+
+/*
+ * Lock-free single-producer/single-consumer ring of periods.
+ *
+ * The producer renders up to "depth" periods ahead of the
+ * consumer.  Neither side ever takes a lock; the consumer
+ * posts a semaphore when it frees a slot so that the producer
+ * can sleep while the ring is full.
+ */
+struct ring_struct {
+	unsigned char *buf;
+	int slot_size;		/* bytes per period */
+	int slots;		/* capacity, a power of two */
+	atomic_int depth;	/* periods to render ahead */
+	atomic_uint head;	/* next slot to read */
+	atomic_uint tail;	/* next slot to write */
+	sem_t space;
+};
+
+extern int ring_create(struct ring_struct *rp, int slots, int slot_size, int depth);
+extern void ring_destroy(struct ring_struct *rp);
+extern unsigned char *ring_write_slot(struct ring_struct *rp);
+extern void ring_publish(struct ring_struct *rp);
+extern int ring_wait_space(struct ring_struct *rp, int timeout_ms);
+extern unsigned char *ring_read_slot(struct ring_struct *rp);
+extern void ring_release(struct ring_struct *rp);
+extern void ring_kick(struct ring_struct *rp);
+extern int ring_level(struct ring_struct *rp);
+
+#endif
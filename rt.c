@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2018 by Ross Wille. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * COPYING file for more details.
+ */
+
+/*
+ * Startup realtime profile: lock and pre-fault memory so the
+ * audio path never page-faults, give the audio and render
+ * threads their realtime policy (and a core, if asked), then
+ * check what the kernel actually granted.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "rt.h"
+
+struct rt_thread {
+	pthread_t thread;
+	const char *name;
+	int policy;		/* as asked for */
+	int priority;
+	int cpu;		/* -1 for any */
+	int err;		/* from setting the policy, or 0 */
+	int cpu_err;		/* from pinning, or 0 */
+};
+
+struct rt_struct {
+	int mem_err;		/* from mlockall(), or 0 */
+	int n_threads;
+	struct rt_thread threads[RT_MAX_THREADS];
+};
+
+static struct rt_struct rt;
+
+static const char *rt_policy_name(int policy)
+{
+	switch (policy) {
+	case SCHED_FIFO:
+		return "SCHED_FIFO";
+	case SCHED_RR:
+		return "SCHED_RR";
+	case SCHED_OTHER:
+		return "SCHED_OTHER";
+	default:
+		return "SCHED_?";
+	}
+}
+
+/*
+ * Lock everything mapped now and later.  Without the lock
+ * (RLIMIT_MEMLOCK), buffers should still be pre-faulted.
+ */
+int rt_lock_memory(void)
+{
+	rt.mem_err = 0;
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+		rt.mem_err = errno;
+
+	return rt.mem_err ? -1 : 0;
+}
+
+/*
+ * Write every page of buf (with what it already holds), so
+ * that calloc()'s shared zero pages become real ones now and
+ * not on first use in the audio thread.
+ */
+void rt_prefault(void *buf, size_t len)
+{
+	volatile unsigned char *p = buf;
+	long page;
+	size_t i;
+
+	page = sysconf(_SC_PAGESIZE);
+	if (page <= 0)
+		page = 4096;
+	for (i = 0; i < len; i += page)
+		p[i] = p[i];
+	if (len)
+		p[len - 1] = p[len - 1];
+}
+
+/*
+ * Called first thing in each realtime thread
+ */
+void rt_prefault_stack(void)
+{
+	unsigned char stack[RT_STACK_PREFAULT];
+
+	memset(stack, 0, sizeof(stack));
+	__asm__ __volatile__("" : : "r"(stack) : "memory");
+}
+
+/*
+ * Apply a realtime policy and optional CPU to a thread.  The
+ * result is kept for rt_report(); a failure is not fatal.
+ */
+int rt_setup_thread(pthread_t thread, const char *name, int policy,
+	int priority, int cpu)
+{
+	struct sched_param param;
+	struct rt_thread *tp;
+	cpu_set_t cpus;
+
+	if (rt.n_threads == RT_MAX_THREADS)
+		return -1;
+	tp = &rt.threads[rt.n_threads++];
+	tp->thread = thread;
+	tp->name = name;
+	tp->policy = policy;
+	tp->priority = priority;
+	tp->cpu = cpu;
+
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = priority;
+	tp->err = pthread_setschedparam(thread, policy, &param);
+
+	tp->cpu_err = 0;
+	if (cpu >= CPU_SETSIZE)
+		tp->cpu_err = EINVAL;
+	else if (cpu >= 0) {
+		CPU_ZERO(&cpus);
+		CPU_SET(cpu, &cpus);
+		tp->cpu_err = pthread_setaffinity_np(thread, sizeof(cpus), &cpus);
+	}
+	return (tp->err || tp->cpu_err) ? -1 : 0;
+}
+
+/*
+ * Say what was granted, from the kernel's point of view, and
+ * warn loudly if anything fell short.  Returns nonzero when
+ * running degraded.
+ */
+int rt_report(void)
+{
+	struct sched_param param;
+	struct rt_thread *tp;
+	int degraded;
+	int policy;
+	int i;
+
+	degraded = (rt.mem_err != 0);
+	for (i = 0; i < rt.n_threads; i++) {
+		tp = &rt.threads[i];
+		if (pthread_getschedparam(tp->thread, &policy, &param) != 0) {
+			policy = SCHED_OTHER;
+			param.sched_priority = 0;
+		}
+		if ((policy != tp->policy) || (param.sched_priority != tp->priority))
+			degraded = 1;
+		if (tp->cpu_err)
+			degraded = 1;
+
+		fprintf(stderr, "%s thread: %s/%d", tp->name,
+			rt_policy_name(policy), param.sched_priority);
+		if (tp->err)
+			fprintf(stderr, " (%s/%d refused: %s)", rt_policy_name(tp->policy),
+				tp->priority, strerror(tp->err));
+		if (tp->cpu >= 0) {
+			if (tp->cpu_err)
+				fprintf(stderr, ", not pinned to cpu %d (%s)", tp->cpu,
+					strerror(tp->cpu_err));
+			else
+				fprintf(stderr, ", cpu %d", tp->cpu);
+		}
+		fprintf(stderr, "\r\n");
+	}
+	if (rt.mem_err)
+		fprintf(stderr, "memory: not locked (%s), buffers pre-faulted only\r\n",
+			strerror(rt.mem_err));
+	else
+		fprintf(stderr, "memory: locked\r\n");
+
+	if (degraded)
+		fprintf(stderr, "warning: running in degraded (non-realtime) mode, expect "
+			"dropouts under load; grant rtprio and memlock in limits.conf, "
+			"or CAP_SYS_NICE and CAP_IPC_LOCK\r\n");
+
+	return degraded;
+}
@@ -0,0 +1,31 @@
+/*
+ * Copyright (C) 2018 by Ross Wille. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * COPYING file for more details.
+ */
+
+#ifndef _RT_H_
+#define _RT_H_
+
+#include <stddef.h>
+#include <pthread.h>
+
+#define RT_STACK_PREFAULT	(64 * 1024)	/* bytes of stack touched per RT thread */
+#define RT_MAX_THREADS		4
+
+extern int rt_lock_memory(void);
+extern void rt_prefault(void *buf, size_t len);
+extern void rt_prefault_stack(void);
+extern int rt_setup_thread(pthread_t thread, const char *name, int policy,
+	int priority, int cpu);
+extern int rt_report(void);
+
+#endif
@@ -0,0 +1,289 @@
+/*
+ * Copyright (C) 2018 by Ross Wille. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * COPYING file for more details.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "rtlog.h"
+
+#define SPEC_LEN		24
+
+union rtlog_arg {
+	long long i;
+	double d;
+	const void *p;
+};
+
+/*
+ * seq says whose turn a slot is: it equals the write position
+ * when the slot is free for that write, position + 1 once the
+ * record is published, and position + RTLOG_SLOTS once it has
+ * been read (free for the next lap).
+ */
+struct rtlog_rec {
+	atomic_uint seq;
+	int n_args;
+	long long ts_ns;
+	const char *fmt;
+	union rtlog_arg args[RTLOG_ARGS];
+};
+
+struct rtlog_struct {
+	struct rtlog_rec rec[RTLOG_SLOTS];
+	atomic_uint tail;		/* next write, shared by producers */
+	unsigned int head;		/* next read, drainer only */
+	atomic_uint dropped;
+	unsigned int reported;		/* drops already reported */
+	long long start_ns;
+};
+
+static struct rtlog_struct rtl;
+
+static long long rtlog_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*
+ * Before any thread logs
+ */
+void rtlog_init(void)
+{
+	int i;
+
+	for (i = 0; i < RTLOG_SLOTS; i++)
+		atomic_init(&rtl.rec[i].seq, i);
+	atomic_init(&rtl.tail, 0);
+	atomic_init(&rtl.dropped, 0);
+	rtl.head = 0;
+	rtl.reported = 0;
+	rtl.start_ns = rtlog_now();
+}
+
+/*
+ * Parse one conversion starting just after its '%'.  Returns
+ * a pointer to the conversion character and sets *len to the
+ * number of 'l's (1 for 'z').
+ */
+static const char *rtlog_spec(const char *p, int *len)
+{
+	while (*p && strchr("-+ #0123456789.", *p))
+		p++;
+	*len = 0;
+	for (; (*p == 'l') || (*p == 'h') || (*p == 'z'); p++) {
+		if (*p == 'l')
+			(*len)++;
+		else if (*p == 'z')
+			*len = 1;
+	}
+	return p;
+}
+
+static int rtlog_args(const char *fmt, va_list ap, union rtlog_arg *args)
+{
+	const char *p;
+	int len;
+	int n = 0;
+
+	for (p = fmt; *p && (n < RTLOG_ARGS); p++) {
+		if (*p != '%')
+			continue;
+		if (*++p == '%')
+			continue;
+		p = rtlog_spec(p, &len);
+
+		switch (*p) {
+		case 'd':
+		case 'i':
+			args[n++].i = (len >= 2) ? va_arg(ap, long long) :
+				(len == 1) ? va_arg(ap, long) : va_arg(ap, int);
+			break;
+		case 'u':
+		case 'x':
+		case 'X':
+		case 'o':
+			args[n++].i = (len >= 2) ? va_arg(ap, unsigned long long) :
+				(len == 1) ? va_arg(ap, unsigned long) : va_arg(ap, unsigned int);
+			break;
+		case 'c':
+			args[n++].i = va_arg(ap, int);
+			break;
+		case 'e':
+		case 'f':
+		case 'g':
+			args[n++].d = va_arg(ap, double);
+			break;
+		case 's':
+		case 'p':
+			args[n++].p = va_arg(ap, const void *);
+			break;
+		default:
+			return n;
+		}
+	}
+	return n;
+}
+
+void rtlog(const char *fmt, ...)
+{
+	struct rtlog_rec *rp;
+	unsigned int pos;
+	unsigned int seq;
+	va_list ap;
+	int diff;
+
+	pos = atomic_load_explicit(&rtl.tail, memory_order_relaxed);
+	for (;;) {
+		rp = &rtl.rec[pos & (RTLOG_SLOTS - 1)];
+		seq = atomic_load_explicit(&rp->seq, memory_order_acquire);
+		diff = (int)(seq - pos);
+		if (diff == 0) {
+			if (atomic_compare_exchange_weak_explicit(&rtl.tail, &pos, pos + 1,
+			    memory_order_relaxed, memory_order_relaxed))
+				break;
+		}
+		else if (diff < 0) {
+			/* a lap behind: the drainer has not caught up */
+			atomic_fetch_add_explicit(&rtl.dropped, 1, memory_order_relaxed);
+			return;
+		}
+		else {
+			pos = atomic_load_explicit(&rtl.tail, memory_order_relaxed);
+		}
+	}
+
+	rp->ts_ns = rtlog_now();
+	rp->fmt = fmt;
+	va_start(ap, fmt);
+	rp->n_args = rtlog_args(fmt, ap, rp->args);
+	va_end(ap);
+
+	atomic_store_explicit(&rp->seq, pos + 1, memory_order_release);
+}
+
+/*
+ * printf one record, a conversion at a time, with each
+ * argument passed back at the type it was read as.  Trailing
+ * newlines are replaced by "\r\n" for the raw-mode tty.
+ */
+static void rtlog_format(FILE *fp, const struct rtlog_rec *rp)
+{
+	char spec[SPEC_LEN];
+	const union rtlog_arg *ap = rp->args;
+	const char *end;
+	const char *p;
+	const char *q;
+	int len;
+	int n = 0;
+
+	fprintf(fp, "[%11.6f] ", (rp->ts_ns - rtl.start_ns) / 1.0e9);
+
+	end = rp->fmt + strlen(rp->fmt);
+	while ((end > rp->fmt) && ((end[-1] == '\n') || (end[-1] == '\r')))
+		end--;
+
+	for (p = rp->fmt; p < end; p = q + 1) {
+		q = p;
+		while ((q < end) && (*q != '%'))
+			q++;
+		fwrite(p, 1, q - p, fp);
+		if (q >= end)
+			break;
+		if (q[1] == '%') {
+			fputc('%', fp);
+			q++;
+			continue;
+		}
+
+		p = q;
+		q = rtlog_spec(q + 1, &len);
+		if ((q >= end) || (n >= rp->n_args) || (q - p + 2 > SPEC_LEN))
+			break;
+		memcpy(spec, p, q - p + 1);
+		spec[q - p + 1] = '\0';
+
+		switch (*q) {
+		case 'd':
+		case 'i':
+			if (len >= 2)
+				fprintf(fp, spec, (long long)ap[n].i);
+			else if (len == 1)
+				fprintf(fp, spec, (long)ap[n].i);
+			else
+				fprintf(fp, spec, (int)ap[n].i);
+			break;
+		case 'u':
+		case 'x':
+		case 'X':
+		case 'o':
+			if (len >= 2)
+				fprintf(fp, spec, (unsigned long long)ap[n].i);
+			else if (len == 1)
+				fprintf(fp, spec, (unsigned long)ap[n].i);
+			else
+				fprintf(fp, spec, (unsigned int)ap[n].i);
+			break;
+		case 'c':
+			fprintf(fp, spec, (int)ap[n].i);
+			break;
+		case 'e':
+		case 'f':
+		case 'g':
+			fprintf(fp, spec, ap[n].d);
+			break;
+		case 's':
+			fprintf(fp, spec, ap[n].p ? (const char *)ap[n].p : "(null)");
+			break;
+		case 'p':
+			fprintf(fp, spec, ap[n].p);
+			break;
+		}
+		n++;
+	}
+	fputs("\r\n", fp);
+}
+
+/*
+ * Format and write everything logged so far.  One drainer at
+ * a time.  Returns the number of records written.
+ */
+int rtlog_drain(FILE *fp)
+{
+	struct rtlog_rec *rp;
+	unsigned int dropped;
+	int n = 0;
+
+	for (;;) {
+		rp = &rtl.rec[rtl.head & (RTLOG_SLOTS - 1)];
+		if (atomic_load_explicit(&rp->seq, memory_order_acquire) != rtl.head + 1)
+			break;
+		rtlog_format(fp, rp);
+		atomic_store_explicit(&rp->seq, rtl.head + RTLOG_SLOTS, memory_order_release);
+		rtl.head++;
+		n++;
+	}
+
+	dropped = atomic_load_explicit(&rtl.dropped, memory_order_relaxed);
+	if (dropped != rtl.reported) {
+		fprintf(fp, "rtlog: %u records dropped\r\n", dropped - rtl.reported);
+		rtl.reported = dropped;
+	}
+	return n;
+}
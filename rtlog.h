@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2018 by Ross Wille. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * COPYING file for more details.
+ */
+
+#ifndef _RTLOG_H_
+#define _RTLOG_H_
+
+#include <stdio.h>
+
+#include "config.h"
+
+/*
+ * Lock-free log for the audio and render threads.
+ *
+ * rtlog() only copies the format pointer and the raw arguments
+ * into a fixed ring; the text is formatted later by whichever
+ * thread calls rtlog_drain().  A full ring drops the record and
+ * counts it rather than wait.  The format, and any %s argument,
+ * must outlive the record: use string literals.
+ *
+ * Conversions: d i u x X o c with h/l/ll/z, e f g, s and p.
+ * '*' widths are not supported.
+ */
+#define RTLOG_SLOTS		256	/* power of two */
+#define RTLOG_ARGS		8
+
+#ifdef DEBUG
+#define RT_DPRINTF(fmt, args...)	rtlog(fmt, ##args)
+#else
+#define RT_DPRINTF(args...)		do {} while (0)
+#endif
+
+extern void rtlog_init(void);
+extern void rtlog(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+extern int rtlog_drain(FILE *fp);
+
+#endif
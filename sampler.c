@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2018 by Ross Wille. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * COPYING file for more details.
+ */
+
+/*
+ * Fenwick (binary indexed) tree over the item weights.
+ *
+ * tree[i] holds the sum of the weights of items (i - lowbit(i),
+ * i], so a prefix sum or a change of one weight touches log n
+ * nodes, and a draw descends from the top in log n steps.
+ * Changes are applied as deltas; the tree is rebuilt from the
+ * weights every n changes so that rounding cannot build up.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sampler.h"
+
+#define LOWBIT(_i)	((_i) & -(_i))
+
+static void sampler_build(struct sampler_struct *sp)
+{
+	int parent;
+	int i;
+
+	for (i = 1; i <= sp->n; i++)
+		sp->tree[i] = sp->weight[i - 1];
+	for (i = 1; i <= sp->n; i++) {
+		parent = i + LOWBIT(i);
+		if (parent <= sp->n)
+			sp->tree[parent] += sp->tree[i];
+	}
+	sp->updates = 0;
+}
+
+/*
+ * Take n weights, stride bytes apart, e.g. a member of an
+ * array of structures.  Negative weights count as zero.
+ */
+int sampler_init(struct sampler_struct *sp, const float *weights, int n, int stride)
+{
+	const char *p = (const char *)weights;
+	int i;
+
+	memset(sp, 0, sizeof(*sp));
+	if (n <= 0)
+		return -1;
+
+	sp->tree = malloc((n + 1) * sizeof(double));
+	sp->weight = malloc(n * sizeof(double));
+	if ((sp->tree == NULL) || (sp->weight == NULL)) {
+		sampler_fini(sp);
+		return -1;
+	}
+	sp->n = n;
+	for (sp->top = 1; sp->top * 2 <= n; sp->top *= 2)
+		;
+
+	for (i = 0; i < n; i++) {
+		sp->weight[i] = *(const float *)(p + i * stride);
+		if (sp->weight[i] < 0.0)
+			sp->weight[i] = 0.0;
+	}
+	sampler_build(sp);
+
+	return 0;
+}
+
+void sampler_fini(struct sampler_struct *sp)
+{
+	free(sp->tree);
+	free(sp->weight);
+	memset(sp, 0, sizeof(*sp));
+}
+
+void sampler_set(struct sampler_struct *sp, int i, double w)
+{
+	double delta;
+	int k;
+
+	if (w < 0.0)
+		w = 0.0;
+	delta = w - sp->weight[i];
+	sp->weight[i] = w;
+
+	if (++sp->updates >= sp->n) {
+		sampler_build(sp);
+		return;
+	}
+	for (k = i + 1; k <= sp->n; k += LOWBIT(k))
+		sp->tree[k] += delta;
+}
+
+double sampler_total(const struct sampler_struct *sp)
+{
+	double sum = 0.0;
+	int k;
+
+	for (k = sp->n; k > 0; k -= LOWBIT(k))
+		sum += sp->tree[k];
+	return sum;
+}
+
+/*
+ * The item at point x within the total weight.  Items of zero
+ * weight are never returned, unless every weight is zero.
+ */
+int sampler_find(const struct sampler_struct *sp, double x)
+{
+	int pos = 0;
+	int step;
+
+	for (step = sp->top; step; step >>= 1) {
+		if ((pos + step <= sp->n) && (sp->tree[pos + step] <= x)) {
+			pos += step;
+			x -= sp->tree[pos];
+		}
+	}
+
+	/* x at or past the total, by rounding */
+	if (pos >= sp->n) {
+		pos = sp->n - 1;
+		while ((pos > 0) && (sp->weight[pos] == 0.0))
+			pos--;
+	}
+	return pos;
+}
+
+#ifdef MAIN
+#include <stdio.h>
+#include <time.h>
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1.0e9;
+}
+
+/*
+ * The old symbol_chooser(): total the weights, then scan
+ */
+static int linear_draw(const float *w, int n, double u)
+{
+	float sum;
+	float x;
+	int i;
+
+	sum = 0.0;
+	for (i = 0; i < n; i++)
+		sum += w[i];
+	x = u * sum;
+	sum = 0.0;
+	for (i = 0; i < n; i++) {
+		sum += w[i];
+		if (x < sum)
+			break;
+	}
+	return (i < n) ? i : n - 1;
+}
+
+int main(int argc, char *argv[])
+{
+	static const int sizes[] = {43, 1000, 10000, 100000, 1000000};
+	struct sampler_struct s;
+	unsigned short xsubi[3] = {1, 2, 3};
+	unsigned long *counts;
+	double lin_ns;
+	double draw_ns;
+	double set_ns;
+	double worst;
+	double err;
+	double t;
+	float *w;
+	long reps;
+	long sink;
+	long r;
+	int n;
+	int i;
+	int k;
+
+	printf("%10s %14s %14s %14s\n", "items", "linear draw", "fenwick draw", "fenwick set");
+	sink = 0;
+	for (k = 0; k < (int)(sizeof(sizes) / sizeof(sizes[0])); k++) {
+		n = sizes[k];
+		w = malloc(n * sizeof(float));
+		for (i = 0; i < n; i++)
+			w[i] = 0.5 + erand48(xsubi);
+		sampler_init(&s, w, n, sizeof(float));
+
+		reps = 20000000L / n + 10;
+		t = now();
+		for (r = 0; r < reps; r++)
+			sink += linear_draw(w, n, erand48(xsubi));
+		lin_ns = (now() - t) / reps * 1.0e9;
+
+		reps = 2000000;
+		t = now();
+		for (r = 0; r < reps; r++)
+			sink += sampler_find(&s, erand48(xsubi) * sampler_total(&s));
+		draw_ns = (now() - t) / reps * 1.0e9;
+
+		t = now();
+		for (r = 0; r < reps; r++) {
+			i = nrand48(xsubi) % n;
+			sampler_set(&s, i, s.weight[i] * ((r & 1) ? 0.8 : 1.25));
+		}
+		set_ns = (now() - t) / reps * 1.0e9;
+
+		printf("%10d %11.1f ns %11.1f ns %11.1f ns\n", n, lin_ns, draw_ns, set_ns);
+		sampler_fini(&s);
+		free(w);
+	}
+
+	/* the draws follow the weights */
+	n = 43;
+	w = malloc(n * sizeof(float));
+	counts = calloc(n, sizeof(*counts));
+	for (i = 0; i < n; i++)
+		w[i] = (i % 5) ? i + 1 : 0.0;
+	sampler_init(&s, w, n, sizeof(float));
+	reps = 10000000;
+	for (r = 0; r < reps; r++)
+		counts[sampler_find(&s, erand48(xsubi) * sampler_total(&s))]++;
+	worst = 0.0;
+	for (i = 0; i < n; i++) {
+		if (w[i] == 0.0) {
+			if (counts[i])
+				printf("item %d has no weight but was drawn\n", i);
+			continue;
+		}
+		err = counts[i] / (reps * w[i] / sampler_total(&s)) - 1.0;
+		if ((err < 0 ? -err : err) > worst)
+			worst = (err < 0) ? -err : err;
+	}
+	printf("distribution over %d items, %ld draws: worst error %0.2f%%\n", n, reps, worst * 100.0);
+	sampler_fini(&s);
+	free(counts);
+	free(w);
+
+	return sink == 42;
+}
+#endif
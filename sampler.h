@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) 2018 by Ross Wille. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * COPYING file for more details.
+ */
+
+#ifndef _SAMPLER_H_
+#define _SAMPLER_H_
+
+/*
+ * Weighted random choice among n items, with O(log n) draws
+ * and O(log n) weight changes
+ */
+struct sampler_struct {
+	int n;
+	int top;		/* highest power of two <= n */
+	double *tree;		/* Fenwick tree, 1-based */
+	double *weight;		/* per item, 0-based */
+	int updates;		/* since the last rebuild */
+};
+
+extern int sampler_init(struct sampler_struct *sp, const float *weights, int n, int stride);
+extern void sampler_fini(struct sampler_struct *sp);
+extern void sampler_set(struct sampler_struct *sp, int i, double w);
+extern double sampler_total(const struct sampler_struct *sp);
+extern int sampler_find(const struct sampler_struct *sp, double x);
+
+#endif
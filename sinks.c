@@ -0,0 +1,304 @@
+/*
+ * Copyright (C) 2018 by Ross Wille. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * COPYING file for more details.
+ */
+
+/*
+ * Audio sinks that need no sound card: they make it possible to
+ * run, profile and benchmark the pipeline on any machine.
+ *
+ *   null[:fast]	discard the audio, paced in real time unless "fast"
+ *   wav:FILE		write a WAV file, paced in real time
+ *   stdout		raw interleaved frames on stdout
+ *
+ * They take whatever --format asks for, S16_LE by default.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/timerfd.h>
+
+#include "config.h"
+#include "alsa.h"
+#include "audio.h"
+#include "prof.h"
+#include "wav.h"
+
+#define NS_PER_SEC		1000000000L
+
+/*
+ * Real-time pacing with a periodic CLOCK_MONOTONIC timerfd.
+ * The kernel keeps the period, so sleep overshoot does not
+ * accumulate, and audio_poll() lets the session end mid-sleep.
+ */
+static int pace_fd = -1;
+static long period_ns;
+static struct timespec paused_at;
+
+static int pace_arm(long ns)
+{
+	struct itimerspec its;
+
+	its.it_interval.tv_sec = ns / NS_PER_SEC;
+	its.it_interval.tv_nsec = ns % NS_PER_SEC;
+	its.it_value = its.it_interval;
+
+	return timerfd_settime(pace_fd, 0, &its, NULL);
+}
+
+static int pace_start(int enable)
+{
+	period_ns = (double)FRAMES_PER_PERIOD * NS_PER_SEC / settings.sample_rate;
+	if (!enable)
+		return 0;
+
+	pace_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+	if (pace_fd < 0)
+		return -1;
+
+	return pace_arm(period_ns);
+}
+
+/*
+ * Stop the clock while idle.  pace_resume() restarts it and
+ * returns the time it was stopped for, in frames.
+ */
+static void pace_pause(void)
+{
+	clock_gettime(CLOCK_MONOTONIC, &paused_at);
+	if (pace_fd >= 0)
+		pace_arm(0);
+}
+
+static long pace_resume(void)
+{
+	struct timespec now;
+	long long ns;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ns = (now.tv_sec - paused_at.tv_sec) * (long long)NS_PER_SEC +
+		(now.tv_nsec - paused_at.tv_nsec);
+	if (pace_fd >= 0)
+		pace_arm(period_ns);
+
+	return ns * settings.sample_rate / NS_PER_SEC;
+}
+
+static void pace_stop(void)
+{
+	if (pace_fd >= 0)
+		close(pace_fd);
+	pace_fd = -1;
+}
+
+static void pace_wait(void)
+{
+	struct pollfd pfd;
+	uint64_t ticks;
+
+	if (pace_fd < 0)
+		return;
+
+	pfd.fd = pace_fd;
+	pfd.events = POLLIN;
+	if (audio_poll(&pfd, 1, -1) > 0) {
+		if (read(pace_fd, &ticks, sizeof(ticks)) < 0)
+			perror("pace_wait");
+	}
+}
+
+/*
+ * Files and pipes take any format, so there is nothing to
+ * negotiate
+ */
+static void sink_format(void)
+{
+	if (settings.format < 0)
+		settings.format = PCM_S16;
+}
+
+/*
+ * null sink
+ */
+static int null_open(const char *arg)
+{
+	if ((arg[0] != '\0') && (strcmp(arg, "fast") != 0)) {
+		fprintf(stderr, "null: unknown option %s\n", arg);
+		return -1;
+	}
+	sink_format();
+	return pace_start(arg[0] == '\0');
+}
+
+static void null_close(void)
+{
+	pace_stop();
+}
+
+static int null_play(void)
+{
+	audio_period_done(audio_period());
+	pace_wait();
+
+	return 0;
+}
+
+static void null_resume(void)
+{
+	pace_resume();
+}
+
+const struct audio_backend null_backend = {
+	.name = "null",
+	.open = null_open,
+	.close = null_close,
+	.play = null_play,
+	.pause = pace_pause,
+	.resume = null_resume,
+};
+
+/*
+ * WAV file sink
+ */
+static struct wav_struct wav;
+
+static int wav_open(const char *arg)
+{
+	if (arg[0] == '\0') {
+		fprintf(stderr, "wav: no file name given\n");
+		return -1;
+	}
+	sink_format();
+	if (wav_create(&wav, arg, settings.sample_rate, settings.n_chans, settings.format) < 0) {
+		fprintf(stderr, "wav: cannot create %s\n", arg);
+		return -1;
+	}
+	if (pace_start(1) < 0) {
+		wav_close(&wav);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void wav_close_sink(void)
+{
+	pace_stop();
+	if (wav_close(&wav) < 0)
+		fprintf(stderr, "wav: error closing file\r\n");
+}
+
+static int wav_play(void)
+{
+	unsigned char *buf;
+	int rc;
+
+	buf = audio_period();
+	PROF_START(t_write);
+	rc = wav_write(&wav, buf, FRAMES_PER_PERIOD);
+	PROF_STOP(PROF_PCM_WRITE, t_write);
+	audio_period_done(buf);
+	if (rc < 0)
+		return -1;
+	pace_wait();
+
+	return 0;
+}
+
+/*
+ * The recording keeps the session's timing: the idle spell is
+ * skipped over as a hole, so resuming after any think time
+ * costs one seek.
+ */
+static void wav_resume(void)
+{
+	wav_skip(&wav, pace_resume());
+}
+
+const struct audio_backend wav_backend = {
+	.name = "wav",
+	.open = wav_open,
+	.close = wav_close_sink,
+	.play = wav_play,
+	.pause = pace_pause,
+	.resume = wav_resume,
+};
+
+/*
+ * stdout sink.  The reader (aplay, sox, ...) sets the pace.
+ * The original stdout is kept for the PCM and stdout is pointed
+ * at stderr so that the trainer's messages stay out of the stream.
+ */
+static int pcm_fd = -1;
+
+static int stdout_open(const char *arg)
+{
+	sink_format();
+	pcm_fd = dup(STDOUT_FILENO);
+	if (pcm_fd < 0)
+		return -1;
+	fflush(stdout);
+	dup2(STDERR_FILENO, STDOUT_FILENO);
+
+	return 0;
+}
+
+static void stdout_close(void)
+{
+	close(pcm_fd);
+	pcm_fd = -1;
+}
+
+static int stdout_play(void)
+{
+	unsigned char *period;
+	unsigned char *buf;
+	struct pollfd pfd;
+	int len = PERIOD_SIZE;
+	int n;
+
+	pfd.fd = pcm_fd;
+	pfd.events = POLLOUT;
+	period = buf = audio_period();
+	PROF_START(t_write);
+	while (len) {
+		if (audio_poll(&pfd, 1, -1) < 0) {
+			len = 0;	/* stopping */
+			break;
+		}
+		n = write(pcm_fd, buf, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		buf += n;
+		len -= n;
+	}
+	PROF_STOP(PROF_PCM_WRITE, t_write);
+	audio_period_done(period);
+
+	return len ? -1 : 0;
+}
+
+const struct audio_backend stdout_backend = {
+	.name = "stdout",
+	.open = stdout_open,
+	.close = stdout_close,
+	.play = stdout_play,
+};
@@ -0,0 +1,502 @@
+/*
+ * Copyright (C) 2018 by Ross Wille. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * COPYING file for more details.
+ */
+
+/*
+ * Sample-rate conversion.
+ *
+ * Output sample k sits at input position k / ratio.  Its
+ * fractional part selects a row (phase) of a table of the
+ * windowed-sinc kernel sampled at 1/phases steps, and the row
+ * is applied to the input around that position.  The input is
+ * streamed through buf[], which keeps the kernel's worth of
+ * history between calls.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "src.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SRC_KERNEL	__attribute__((target_clones("avx2", "default")))
+#else
+#define SRC_KERNEL
+#endif
+
+typedef float v8sf __attribute__((vector_size(SRC_LANES * sizeof(float))));
+
+/*
+ * Kernel half-width in taps (at the lower rate), Kaiser beta,
+ * passband edge as a fraction of the lower Nyquist, and the
+ * largest table
+ */
+struct src_quality {
+	const char *name;
+	int half_taps;
+	double beta;
+	double rolloff;
+	int max_phases;
+};
+
+static const struct src_quality qualities[N_SRC_QUALITIES] = {
+	[SRC_FAST] = {"fast", 8, 6.0, 0.90, 256},
+	[SRC_MEDIUM] = {"medium", 16, 8.0, 0.95, 512},
+	[SRC_BEST] = {"best", 32, 10.0, 0.97, 1024},
+};
+
+int src_quality_lookup(const char *name)
+{
+	int i;
+
+	for (i = 0; i < N_SRC_QUALITIES; i++) {
+		if (strcmp(name, qualities[i].name) == 0)
+			return i;
+	}
+	return -1;
+}
+
+const char *src_quality_name(int quality)
+{
+	if ((quality < 0) || (quality >= N_SRC_QUALITIES))
+		return "?";
+	return qualities[quality].name;
+}
+
+static long long gcd(long long a, long long b)
+{
+	long long t;
+
+	while (b) {
+		t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+/*
+ * Modified Bessel function of the first kind, order 0
+ */
+static double bessel_i0(double x)
+{
+	double sum = 1.0;
+	double term = 1.0;
+	int k;
+
+	for (k = 1; k < 50; k++) {
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+		if (term < sum * 1e-12)
+			break;
+	}
+	return sum;
+}
+
+static double kaiser(double x, double beta)
+{
+	if ((x <= -1.0) || (x >= 1.0))
+		return 0.0;
+	return bessel_i0(beta * sqrt(1.0 - x * x)) / bessel_i0(beta);
+}
+
+static double sinc(double x)
+{
+	if (x == 0.0)
+		return 1.0;
+	return sin(M_PI * x) / (M_PI * x);
+}
+
+/*
+ * Build the table and buffer for ratio, with the given number
+ * of phases.  Row "phases" is row 0 one input later, so that
+ * ratio mode can always interpolate toward the next row.
+ */
+static int src_setup(struct src_struct *sp, double ratio, int quality, int phases)
+{
+	const struct src_quality *qp = &qualities[quality];
+	double scale;
+	double width;
+	double cutoff;
+	double sum;
+	double x;
+	float *row;
+	int p;
+	int j;
+
+	sp->quality = quality;
+	sp->ratio = ratio;
+	sp->phases = phases;
+
+	/* when decimating, the kernel widens to cut at the output's Nyquist */
+	scale = (ratio < 1.0) ? ratio : 1.0;
+	width = qp->half_taps / scale;
+	cutoff = scale * qp->rolloff;
+	sp->taps = 2 * (int)ceil(width);
+	sp->taps = (sp->taps + SRC_LANES - 1) / SRC_LANES * SRC_LANES;
+
+	sp->coefs = malloc((phases + 1) * sp->taps * sizeof(float));
+	sp->cap = SRC_CHUNK + 2 * sp->taps;
+	sp->buf = malloc(sp->cap * sizeof(float));
+	if ((sp->coefs == NULL) || (sp->buf == NULL)) {
+		src_fini(sp);
+		return -1;
+	}
+
+	for (p = 0; p <= phases; p++) {
+		row = &sp->coefs[p * sp->taps];
+		sum = 0.0;
+		for (j = 0; j < sp->taps; j++) {
+			/* tap j reads input (position - taps/2 + 1 + j) */
+			x = (j - sp->taps / 2 + 1) - (double)p / phases;
+			row[j] = cutoff * sinc(cutoff * x) * kaiser(x / width, qp->beta);
+			sum += row[j];
+		}
+		/* unity gain at DC for every phase */
+		for (j = 0; j < sp->taps; j++)
+			row[j] /= sum;
+	}
+
+	src_reset(sp);
+	return 0;
+}
+
+/*
+ * Convert between two sample rates.  Uses the exact table when
+ * the reduced ratio fits the quality's phase budget.
+ */
+int src_init(struct src_struct *sp, int in_rate, int out_rate, int quality)
+{
+	long long g;
+
+	memset(sp, 0, sizeof(*sp));
+	if ((in_rate <= 0) || (out_rate <= 0) ||
+	    (quality < 0) || (quality >= N_SRC_QUALITIES))
+		return -1;
+
+	g = gcd(in_rate, out_rate);
+	if (out_rate / g > qualities[quality].max_phases)
+		return src_init_ratio(sp, (double)out_rate / in_rate, quality);
+
+	sp->fixed = 1;
+	sp->up = out_rate / g;
+	sp->down = in_rate / g;
+	sp->step_int = sp->down / sp->up;
+	sp->step_rem = sp->down % sp->up;
+
+	return src_setup(sp, (double)out_rate / in_rate, quality, sp->up);
+}
+
+/*
+ * Convert by an arbitrary ratio, output rate / input rate
+ */
+int src_init_ratio(struct src_struct *sp, double ratio, int quality)
+{
+	memset(sp, 0, sizeof(*sp));
+	if ((ratio < SRC_MIN_RATIO) || (ratio > SRC_MAX_RATIO) ||
+	    (quality < 0) || (quality >= N_SRC_QUALITIES))
+		return -1;
+
+	sp->step = 1.0 / ratio;
+
+	return src_setup(sp, ratio, quality, qualities[quality].max_phases);
+}
+
+void src_fini(struct src_struct *sp)
+{
+	free(sp->coefs);
+	free(sp->buf);
+	sp->coefs = NULL;
+	sp->buf = NULL;
+}
+
+/*
+ * Start a new stream: silent history, so that the first output
+ * lines up with the first input
+ */
+void src_reset(struct src_struct *sp)
+{
+	sp->fill = sp->taps / 2 - 1;
+	memset(sp->buf, 0, sp->fill * sizeof(float));
+	sp->pos = 0;
+	sp->phase = 0;
+	sp->frac = 0.0;
+}
+
+/*
+ * Room needed in out[] for src_process() of n_in samples
+ */
+long src_out_max(const struct src_struct *sp, long n_in)
+{
+	return (long)ceil((n_in + sp->taps) * sp->ratio) + 1;
+}
+
+static inline float dot(const float *a, const float *b, int taps)
+{
+	v8sf acc = {0};
+	v8sf x;
+	v8sf y;
+	float sum;
+	int i;
+
+	for (i = 0; i < taps; i += SRC_LANES) {
+		memcpy(&x, &a[i], sizeof(x));
+		memcpy(&y, &b[i], sizeof(y));
+		acc += x * y;
+	}
+	sum = 0.0f;
+	for (i = 0; i < SRC_LANES; i++)
+		sum += acc[i];
+	return sum;
+}
+
+SRC_KERNEL
+static long src_fixed(struct src_struct *sp, float *out)
+{
+	long n = 0;
+
+	while (sp->pos + sp->taps <= sp->fill) {
+		out[n++] = dot(&sp->buf[sp->pos], &sp->coefs[sp->phase * sp->taps], sp->taps);
+		sp->pos += sp->step_int;
+		sp->phase += sp->step_rem;
+		if (sp->phase >= sp->up) {
+			sp->phase -= sp->up;
+			sp->pos++;
+		}
+	}
+	return n;
+}
+
+SRC_KERNEL
+static long src_ratio(struct src_struct *sp, float *out)
+{
+	const float *row;
+	const float *in;
+	double x;
+	float a;
+	float b;
+	long n = 0;
+	int adv;
+	int r;
+
+	while (sp->pos + sp->taps <= sp->fill) {
+		x = sp->frac * sp->phases;
+		r = x;
+		row = &sp->coefs[r * sp->taps];
+		in = &sp->buf[sp->pos];
+		a = dot(in, row, sp->taps);
+		b = dot(in, row + sp->taps, sp->taps);
+		out[n++] = a + (float)(x - r) * (b - a);
+
+		sp->frac += sp->step;
+		adv = sp->frac;
+		sp->frac -= adv;
+		sp->pos += adv;
+	}
+	return n;
+}
+
+/*
+ * Take all of in[], and write every output that it completes.
+ * Returns the number written; out[] must hold src_out_max().
+ */
+long src_process(struct src_struct *sp, const float *in, long n_in, float *out)
+{
+	long n_out = 0;
+	int shift;
+	int n;
+
+	while (n_in > 0) {
+		/* drop what the kernel has passed; pos may be ahead of fill */
+		shift = (sp->pos < sp->fill) ? sp->pos : sp->fill;
+		memmove(sp->buf, &sp->buf[shift], (sp->fill - shift) * sizeof(float));
+		sp->fill -= shift;
+		sp->pos -= shift;
+
+		n = sp->cap - sp->fill;
+		if (n > n_in)
+			n = n_in;
+		memcpy(&sp->buf[sp->fill], in, n * sizeof(float));
+		sp->fill += n;
+		in += n;
+		n_in -= n;
+
+		if (sp->fixed)
+			n_out += src_fixed(sp, &out[n_out]);
+		else
+			n_out += src_ratio(sp, &out[n_out]);
+	}
+	return n_out;
+}
+
+/*
+ * Output samples for a whole buffer of n_in
+ */
+long src_length(const struct src_struct *sp, long n_in)
+{
+	if (sp->fixed)
+		return (n_in * sp->up + sp->down - 1) / sp->down;
+	return (long)ceil(n_in * sp->ratio);
+}
+
+/*
+ * Convert a whole buffer into src_length(n_in) samples, taking
+ * the input to be silent beyond both ends
+ */
+int src_run(struct src_struct *sp, float *out, const float *in, long n_in)
+{
+	float zeros[SRC_CHUNK];
+	float *tail;
+	long n_out;
+	long done;
+	long n;
+
+	tail = malloc(src_out_max(sp, SRC_CHUNK) * sizeof(float));
+	if (tail == NULL)
+		return -1;
+
+	n_out = src_length(sp, n_in);
+	src_reset(sp);
+	done = src_process(sp, in, n_in, out);
+
+	/* flush the kernel's right half with silence */
+	memset(zeros, 0, sizeof(zeros));
+	while (done < n_out) {
+		n = src_process(sp, zeros, SRC_CHUNK, tail);
+		if (n > n_out - done)
+			n = n_out - done;
+		memcpy(&out[done], tail, n * sizeof(float));
+		done += n;
+	}
+	free(tail);
+
+	return 0;
+}
+
+#ifdef MAIN
+#include <stdio.h>
+#include <time.h>
+
+#define BENCH_RATE_IN		44100
+#define BENCH_RATE_OUT		48000
+#define BENCH_TONE		1000.0
+#define BENCH_SECS		4
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1.0e9;
+}
+
+/*
+ * THD+N: fit the tone at its known frequency over the middle
+ * of the output and compare what is left over with it
+ */
+static double thd_n(const float *out, long n, double freq, double rate)
+{
+	double ss = 0.0;
+	double sc = 0.0;
+	double cc = 0.0;
+	double ys = 0.0;
+	double yc = 0.0;
+	double a;
+	double b;
+	double det;
+	double sig;
+	double err;
+	double s;
+	double c;
+	double r;
+	long lo = n / 4;
+	long hi = 3 * n / 4;
+	long i;
+
+	for (i = lo; i < hi; i++) {
+		s = sin(2.0 * M_PI * freq * i / rate);
+		c = cos(2.0 * M_PI * freq * i / rate);
+		ss += s * s;
+		sc += s * c;
+		cc += c * c;
+		ys += out[i] * s;
+		yc += out[i] * c;
+	}
+	det = ss * cc - sc * sc;
+	a = (ys * cc - yc * sc) / det;
+	b = (yc * ss - ys * sc) / det;
+
+	sig = err = 0.0;
+	for (i = lo; i < hi; i++) {
+		s = a * sin(2.0 * M_PI * freq * i / rate) + b * cos(2.0 * M_PI * freq * i / rate);
+		r = out[i] - s;
+		sig += s * s;
+		err += r * r;
+	}
+	return 10.0 * log10(err / sig);
+}
+
+static void bench(struct src_struct *sp, const float *in, long n_in)
+{
+	float *out;
+	double t;
+	long n;
+	int reps;
+
+	out = malloc(src_out_max(sp, n_in) * sizeof(float));
+	reps = 0;
+	t = now();
+	do {
+		src_reset(sp);
+		n = src_process(sp, in, n_in, out);
+		reps++;
+	} while (now() - t < 0.5);
+	t = now() - t;
+
+	printf("  %-6s %-5s %3d taps %4d phases: %8.2f Msamples/s, THD+N %6.1f dB\n",
+		src_quality_name(sp->quality), sp->fixed ? "fixed" : "ratio", sp->taps, sp->phases,
+		(double)n * reps / t / 1.0e6,
+		thd_n(out, n, BENCH_TONE, BENCH_RATE_IN * sp->ratio));
+	free(out);
+}
+
+int main(int argc, char *argv[])
+{
+	struct src_struct src;
+	float *in;
+	long n_in;
+	long i;
+	int q;
+
+	n_in = BENCH_RATE_IN * BENCH_SECS;
+	in = malloc(n_in * sizeof(float));
+	for (i = 0; i < n_in; i++)
+		in[i] = 0.5 * sin(2.0 * M_PI * BENCH_TONE * i / BENCH_RATE_IN);
+
+	printf("%0.0f Hz tone, %d to %d Hz\n", BENCH_TONE, BENCH_RATE_IN, BENCH_RATE_OUT);
+	for (q = 0; q < N_SRC_QUALITIES; q++) {
+		src_init(&src, BENCH_RATE_IN, BENCH_RATE_OUT, q);
+		bench(&src, in, n_in);
+		src_fini(&src);
+
+		/* a sound card clock 100 ppm fast */
+		src_init_ratio(&src, (double)BENCH_RATE_OUT / BENCH_RATE_IN * 1.0001, q);
+		bench(&src, in, n_in);
+		src_fini(&src);
+	}
+	free(in);
+
+	return 0;
+}
+#endif
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2018 by Ross Wille. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * COPYING file for more details.
+ */
+
+#ifndef _SRC_H_
+#define _SRC_H_
+
+/*
+ * Polyphase windowed-sinc sample-rate converter, mono float.
+ *
+ * A ratio that reduces to at most the quality's phase count
+ * (44.1 to 48 kHz is 160/147) runs from an exact table with
+ * integer stepping.  Any other ratio, including one given as a
+ * number to follow a drifting clock, interpolates between the
+ * two nearest rows.
+ */
+#define SRC_FAST		0
+#define SRC_MEDIUM		1
+#define SRC_BEST		2
+#define N_SRC_QUALITIES		3
+
+#define SRC_LANES		8
+#define SRC_CHUNK		1024	/* input samples buffered per pass */
+#define SRC_MIN_RATIO		(1.0 / 16.0)
+#define SRC_MAX_RATIO		16.0
+
+struct src_struct {
+	int quality;
+	int fixed;		/* exact up/down table */
+	double ratio;		/* output rate / input rate */
+	long long up;		/* fixed: output rate / gcd */
+	long long down;		/* fixed: input rate / gcd */
+	int phases;
+	int taps;		/* per row, a multiple of SRC_LANES */
+	float *coefs;		/* phases + 1 rows */
+
+	float *buf;		/* input history and the chunk being read */
+	int cap;
+	int fill;
+	int pos;		/* first input under the kernel */
+	long long phase;	/* fixed: fraction of an input, in 1/up */
+	long long step_int;
+	long long step_rem;
+	double frac;		/* ratio mode: fraction of an input */
+	double step;
+};
+
+extern int src_quality_lookup(const char *name);
+extern const char *src_quality_name(int quality);
+extern int src_init(struct src_struct *sp, int in_rate, int out_rate, int quality);
+extern int src_init_ratio(struct src_struct *sp, double ratio, int quality);
+extern void src_fini(struct src_struct *sp);
+extern void src_reset(struct src_struct *sp);
+extern long src_out_max(const struct src_struct *sp, long n_in);
+extern long src_process(struct src_struct *sp, const float *in, long n_in, float *out);
+extern long src_length(const struct src_struct *sp, long n_in);
+extern int src_run(struct src_struct *sp, float *out, const float *in, long n_in);
+
+#endif
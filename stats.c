@@ -0,0 +1,293 @@
+/*
+ * Copyright (C) 2018 by Ross Wille. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * COPYING file for more details.
+ */
+
+/*
+ * "cw-trainer stats": accuracy, reaction times and learning
+ * curves from one or more history files, e.g. one per student.
+ */
+
+#define _GNU_SOURCE		/* strptime(), timegm() */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <getopt.h>
+#include <time.h>
+#include <linux/limits.h>
+
+#include "config.h"
+#include "history.h"
+#include "morse.h"
+#include "stats.h"
+
+#define NS_PER_DAY	(86400LL * 1000000000LL)
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1.0e9;
+}
+
+/*
+ * YYYY-MM-DD, UTC, as ns; -1 if it is not a date
+ */
+static int64_t parse_date(const char *s)
+{
+	struct tm tm;
+	char *end;
+
+	memset(&tm, 0, sizeof(tm));
+	end = strptime(s, "%Y-%m-%d", &tm);
+	if ((end == NULL) || (*end != '\0'))
+		return -1;
+	return (int64_t)timegm(&tm) * 1000000000LL;
+}
+
+static void format_date(char *buf, int len, int64_t ns)
+{
+	struct tm tm;
+	time_t t;
+
+	t = ns / 1000000000LL;
+	gmtime_r(&t, &tm);
+	strftime(buf, len, "%Y-%m-%d", &tm);
+}
+
+static double percent(long long part, long long whole)
+{
+	return whole ? 100.0 * part / whole : 0.0;
+}
+
+static void show_help(void)
+{
+	printf("cw-trainer stats [options...] [HISTORY...]\n");
+	printf("  -s, --since=YYYY-MM-DD\n\t\tOnly trials from this day on\n\n");
+	printf("  -u, --until=YYYY-MM-DD\n\t\tOnly trials up to the end of this day\n\n");
+	printf("  -y, --symbol=SYM\n\t\tOnly this symbol, e.g. K or <AR>\n\n");
+	printf("  -e, --every=DAYS\n\t\tLearning curve period [default=7, 0 for none]\n\n");
+	printf("  -h, --help\n\t\tHelp: show syntax\n\n");
+	printf("HISTORY defaults to ~/%s\n", HIST_FILE);
+}
+
+static void print_symbols(const struct hist_stats *sp)
+{
+	const struct histo_struct *hp;
+	long long answers;
+	int i;
+
+	printf("%-6s %10s %7s %7s %10s %10s %10s\n",
+		"symbol", "answers", "right", "again", "react p50", "p90", "p99");
+	for (i = 0; i < n_cw; i++) {
+		answers = sp->right[i] + sp->wrong[i];
+		if ((answers == 0) && (sp->again[i] == 0))
+			continue;
+		hp = &sp->react[i];
+		printf("%-6s %10lld %6.1f%% %7lld %8.0f ms %7.0f ms %7.0f ms\n",
+			cw[i].symbol, answers, percent(sp->right[i], answers), sp->again[i],
+			histo_percentile(hp, 50.0) / 1000.0,
+			histo_percentile(hp, 90.0) / 1000.0,
+			histo_percentile(hp, 99.0) / 1000.0);
+	}
+}
+
+static void print_curve(const struct hist_stats *sp, const struct hist_query *qp)
+{
+	char date[32];
+	int i;
+
+	printf("\n%-10s %10s %7s\n", "from", "answers", "right");
+	for (i = 0; i < qp->n_periods; i++) {
+		if (sp->period_total[i] == 0)
+			continue;
+		format_date(date, sizeof(date), qp->t0 + i * qp->every);
+		printf("%-10s %10lld %6.1f%%\n", date, sp->period_total[i],
+			percent(sp->period_right[i], sp->period_total[i]));
+	}
+}
+
+static long long sum(const long long *v)
+{
+	long long n = 0;
+	int i;
+
+	for (i = 0; i < HIST_SYMBOLS; i++)
+		n += v[i];
+	return n;
+}
+
+int stats_main(int argc, char *argv[])
+{
+	static struct option long_options[] = {
+		{"every", required_argument, 0, 'e'},
+		{"help", no_argument, 0, 'h'},
+		{"since", required_argument, 0, 's'},
+		{"symbol", required_argument, 0, 'y'},
+		{"until", required_argument, 0, 'u'},
+		{0, 0, 0, 0}
+	};
+	char default_fn[PATH_MAX];
+	char *default_fns[1] = {default_fn};
+	struct hist_struct *hists;
+	struct hist_query q;
+	struct hist_stats st;
+	long long right;
+	long long wrong;
+	int64_t t_min;
+	int64_t t_max;
+	double every_days;
+	double t;
+	char **fns;
+	int n_files;
+	int n_open;
+	int c;
+	int i;
+	int k;
+
+	q.since = INT64_MIN;
+	q.until = INT64_MAX;
+	q.sym = -1;
+	every_days = 7.0;
+
+	while ((c = getopt_long(argc, argv, "e:hs:u:y:", long_options, NULL)) != -1) {
+		switch (c) {
+		case 'e':
+			every_days = atof(optarg);
+			break;
+		case 'h':
+			show_help();
+			return 0;
+		case 's':
+			q.since = parse_date(optarg);
+			if (q.since < 0) {
+				fprintf(stderr, "bad date: %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'u':
+			q.until = parse_date(optarg);
+			if (q.until < 0) {
+				fprintf(stderr, "bad date: %s\n", optarg);
+				return 1;
+			}
+			q.until += NS_PER_DAY;
+			break;
+		case 'y':
+			q.sym = cw_find(optarg);
+			if (q.sym < 0) {
+				fprintf(stderr, "no such symbol: %s\n", optarg);
+				return 1;
+			}
+			break;
+		default:
+			show_help();
+			return 1;
+		}
+	}
+
+	fns = argv + optind;
+	n_files = argc - optind;
+	if (n_files == 0) {
+		config_home_path(default_fn, sizeof(default_fn), HIST_FILE);
+		fns = default_fns;
+		n_files = 1;
+	}
+
+	hists = calloc(n_files, sizeof(*hists));
+	if (hists == NULL)
+		return 1;
+
+	/* the curve spans the trials found, within the dates asked */
+	n_open = 0;
+	t_min = INT64_MAX;
+	t_max = INT64_MIN;
+	for (i = 0; i < n_files; i++) {
+		if (hist_open(&hists[i], fns[i]) < 0)
+			continue;
+		if (hists[i].hdr->n_cw != (uint32_t)n_cw) {
+			fprintf(stderr, "%s: recorded with another Morse table, skipped\n", fns[i]);
+			hist_close(&hists[i]);
+			continue;
+		}
+		for (k = 0; k < hists[i].n_blocks; k++) {
+			if (hist_block(&hists[i], k)->t_min < t_min)
+				t_min = hist_block(&hists[i], k)->t_min;
+			if (hist_block(&hists[i], k)->t_max > t_max)
+				t_max = hist_block(&hists[i], k)->t_max;
+		}
+		n_open++;
+	}
+	if (n_open == 0) {
+		free(hists);
+		return 1;
+	}
+	if (q.since > t_min)
+		t_min = q.since;
+	if (q.until - 1 < t_max)
+		t_max = q.until - 1;
+
+	q.t0 = 0;
+	q.every = every_days * NS_PER_DAY;
+	q.n_periods = 0;
+	if ((q.every > 0) && (t_max >= t_min)) {
+		q.t0 = t_min - t_min % NS_PER_DAY;
+		q.n_periods = (t_max - q.t0) / q.every + 1;
+	}
+	if (hist_stats_init(&st, &q) < 0) {
+		free(hists);
+		return 1;
+	}
+
+	t = now();
+	if (n_open > 1)
+		printf("%-20s %10s %7s\n", "student", "answers", "right");
+	for (i = 0; i < n_files; i++) {
+		if (hists[i].map == NULL)
+			continue;
+		right = sum(st.right);
+		wrong = sum(st.wrong);
+		hist_scan(&hists[i], &q, &st);
+		right = sum(st.right) - right;
+		wrong = sum(st.wrong) - wrong;
+		if (n_open > 1)
+			printf("%-20.20s %10lld %6.1f%%\n", hists[i].hdr->student[0] ?
+				hists[i].hdr->student : fns[i], right + wrong,
+				percent(right, right + wrong));
+	}
+	if (n_open > 1)
+		printf("\n");
+	t = now() - t;
+
+	print_symbols(&st);
+	right = sum(st.right);
+	wrong = sum(st.wrong);
+	if (q.n_periods && (right + wrong))
+		print_curve(&st, &q);
+
+	printf("\n%lld answers, %0.1f%% right, %lld repeats\n", right + wrong,
+		percent(right, right + wrong), sum(st.again));
+	fprintf(stderr, "%lld rows in %lld blocks (%lld ruled out by the index) scanned in %0.1f ms\n",
+		st.rows, st.blocks, st.skipped, t * 1000.0);
+	if (st.bad)
+		fprintf(stderr, "%lld corrupt blocks skipped\n", st.bad);
+
+	hist_stats_fini(&st);
+	for (i = 0; i < n_files; i++)
+		hist_close(&hists[i]);
+	free(hists);
+
+	return 0;
+}
@@ -13,51 +13,77 @@
  */
 
 #include <pthread.h>
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <time.h>
 
 #include "config.h"
 #include "alsa.h"
+#include "morse.h"
 #include "symbols.h"
 #include "sym-queue.h"
+#include "synth.h"
+#include "prof.h"
 
-#define N_SQ	64
+#define N_SQ	64	/* at least */
 
 #define LOCK(_s)	pthread_mutex_lock(&(_s).lock)
 #define UNLOCK(_s)	pthread_mutex_unlock(&(_s).lock)
 
-#define SQ_INCR(_c)	sq._c = (sq._c + 1) & (N_SQ - 1)
-#define SQ_DECR(_c)	sq._c = (sq._c - 1) & (N_SQ - 1)
+#define SQ_INCR(_c)	sq._c = (sq._c + 1) & (sq.size - 1)
+#define SQ_DECR(_c)	sq._c = (sq._c - 1) & (sq.size - 1)
 
 struct sqe_struct {
 	struct symbol_struct *sym;
-	char *buf;
-	int remain;
+	float *buf;
+	int remain;		/* frames */
+	int filler;		/* gap added by get_period() */
+	long long enq_ns;
+	long long key_ns;
 };
 
 struct sq_struct {
-	struct sqe_struct sqe[N_SQ];
+	struct sqe_struct *sqe;
+	int size;		/* a power of 2 */
 	int head;
 	int tail;
 	int entries;
+	int queued;		/* entries that are not filler */
 	int empty;
+	float gain[MAX_CHANNELS];
 	pthread_mutex_t lock;
 } sq;
 
-int sq_init(void)
+/*
+ * Room for two texts of max_text bytes, a symbol and a gap for
+ * each, so the next one always fits behind one still playing.
+ */
+int sq_init(int max_text)
 {
+	int size;
 	int i;
 
+	size = N_SQ;
+	while (size < 2 * 2 * max_text + 1)
+		size *= 2;
+	sq.sqe = malloc(size * sizeof(*sq.sqe));
+	if (sq.sqe == NULL)
+		return -1;
+
 	pthread_mutex_init(&sq.lock, NULL);
 
 	LOCK(sq);
 
-	for (i = 0; i < N_SQ; i++) {
+	for (i = 0; i < size; i++) {
 		sq.sqe[i].sym = NULL;
 	}
+	sq.size = size;
 	sq.head = sq.tail = 0;
 	sq.entries = 0;
-	sq.empty = N_SQ;
+	sq.queued = 0;
+	sq.empty = size;
+	synth_pan_gains(sq.gain, settings.n_chans, settings.pan);
 
 	UNLOCK(sq);
 
@@ -66,6 +92,8 @@ int sq_init(void)
 
 void sq_fini(void)
 {
+	free(sq.sqe);
+	sq.sqe = NULL;
 }
 
 /*
@@ -80,44 +108,158 @@ static void _sq_put_gap(void)
 	assert(sq.empty > 0);
 
 	tail = &sq.sqe[sq.tail];
-	tail->sym = &gap_symbol;
-	tail->buf = (void *)gap_symbol.pcm;
-	tail->remain = gap_symbol.samples * FRAME_SIZE;
+	tail->sym = &symbols.gap;
+	tail->buf = symbols.gap.pcm;
+	tail->remain = symbols.gap.samples;
+	tail->filler = 1;
 
 	SQ_INCR(tail);
 	sq.entries++;
 	sq.empty--;
 }
 
+static long long sq_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
 void sq_put(struct symbol_struct *sp)
 {
-	struct sqe_struct *tail;
+	sq_put_key(sp, 0);
+}
 
-	LOCK(sq);
+/*
+ * CALLER MUST BE HOLDING THE SQ LOCK!!!
+ */
+static void _sq_put(struct symbol_struct *sp, long long enq_ns, long long key_ns)
+{
+	struct sqe_struct *tail;
 
 	assert(sq.empty > 0);
 
 	tail = &sq.sqe[sq.tail];
 	tail->sym = sp;
-	tail->buf = (void *)sp->pcm;
-	tail->remain = sp->samples * FRAME_SIZE;
+	tail->buf = sp->pcm;
+	tail->remain = sp->samples;
+	tail->filler = 0;
+	tail->enq_ns = enq_ns;
+	tail->key_ns = key_ns;
 
 	SQ_INCR(tail);
 	sq.entries++;
+	sq.queued++;
 	sq.empty--;
+}
 
+/*
+ * Queue a symbol in answer to a key read at key_ns
+ */
+void sq_put_key(struct symbol_struct *sp, long long key_ns)
+{
+	long long now;
+
+	now = sq_now();
+
+	LOCK(sq);
+	_sq_put(sp, now, key_ns);
 	UNLOCK(sq);
 }
 
+/*
+ * Queue a word or phrase: a letter gap between characters and
+ * a word space between words; prosigns are written <AR>.  Only
+ * the first character is stamped with key_ns.  Returns -1,
+ * queueing nothing, if it would not fit.
+ *
+ * The room is checked and the text queued under one hold of
+ * the lock: get_period_marked() adds filler gaps too.
+ */
+int sq_put_text(const char *text, long long key_ns)
+{
+	const char *p;
+	long long now;
+	int space;
+	int need;
+	int sym;
+
+	need = 0;
+	for (p = text; *p; p++)
+		need += 2;
+
+	now = sq_now();
+
+	LOCK(sq);
+	if (need > sq.empty) {
+		UNLOCK(sq);
+		return -1;
+	}
+
+	space = -1;		/* nothing sent yet */
+	p = text;
+	while (*p) {
+		if (*p == ' ') {
+			if (space == 0)
+				space = 1;
+			p++;
+			continue;
+		}
+		sym = cw_next(&p);
+		if (sym < 0)
+			continue;
+		if (space >= 0)
+			_sq_put(space ? &symbols.space : &symbols.letter, now, 0);
+		_sq_put(&symbols.chars[sym], now, key_ns);
+		key_ns = 0;
+		space = 0;
+	}
+	UNLOCK(sq);
+
+	return 0;
+}
+
 static inline void _sq_drop(void)
 {
 	if (sq.entries) {
+		if (!sq.sqe[sq.head].filler)
+			sq.queued--;
 		SQ_INCR(head);
 		sq.entries--;
 		sq.empty++;
 	}
 }
 
+/*
+ * Returns nonzero while anything other than filler gaps
+ * remains to be played.
+ */
+int sq_busy(void)
+{
+	int busy;
+
+	LOCK(sq);
+	busy = sq.queued;
+	UNLOCK(sq);
+
+	return busy;
+}
+
+/*
+ * Drop the filler gaps at the head of the queue, so that a
+ * symbol queued after an idle spell starts at once.
+ */
+void sq_drop_filler(void)
+{
+	LOCK(sq);
+
+	while (sq.entries && sq.sqe[sq.head].filler)
+		_sq_drop();
+
+	UNLOCK(sq);
+}
+
 #if 0	// unused
 static void sq_drop(void)
 {
@@ -129,26 +271,51 @@ static void sq_drop(void)
 }
 #endif
 
-void get_period(unsigned char *buf, int len)
+void get_period(float *buf, int frames)
+{
+	get_period_marked(buf, frames, NULL, 0);
+}
+
+/*
+ * Fill buf with interleaved float frames, expanding the mono
+ * symbols to settings.n_chans channels.  Up to
+ * max_marks queued symbols that start in this period are
+ * noted in marks[]; returns how many.
+ */
+int get_period_marked(float *buf, int frames, struct sq_mark *marks,
+	int max_marks)
 {
 	struct sqe_struct *head;
+	int n_marks = 0;
+	int total;
 	int n;
 
+	total = frames;
+
+	PROF_START(t_lock);
 	LOCK(sq);
+	PROF_STOP(PROF_SQ_LOCK, t_lock);
 
-	while (len) {
+	while (frames) {
 		/* put gap into an empty queue */
 		if (sq.entries == 0)
 			_sq_put_gap();
 
 		/* point to head of the queue */
 		head = &sq.sqe[sq.head];
-		n = (head->remain < len) ? head->remain : len;
-		memcpy(buf, head->buf, n);
-		buf += n;
+		if (!head->filler && (head->buf == head->sym->pcm) &&
+		    (n_marks < max_marks)) {
+			marks[n_marks].frame = total - frames;
+			marks[n_marks].enq_ns = head->enq_ns;
+			marks[n_marks].key_ns = head->key_ns;
+			n_marks++;
+		}
+		n = (head->remain < frames) ? head->remain : frames;
+		synth_fanout(buf, head->buf, n, settings.n_chans, sq.gain);
+		buf += n * settings.n_chans;
 		head->buf += n;
 		head->remain -= n;
-		len -= n;
+		frames -= n;
 
 		/* drop entry if it has been exhausted */
 		if (head->remain == 0)
@@ -156,4 +323,6 @@ void get_period(unsigned char *buf, int len)
 	}
 
 	UNLOCK(sq);
+
+	return n_marks;
 }
@@ -17,10 +17,27 @@
 
 #include "symbols.h"
 
-extern int sq_init(void);
+/*
+ * Where a queued symbol starts in a rendered period, and when
+ * it was queued (and the key that caused it was read, or 0).
+ * Times are CLOCK_MONOTONIC ns.
+ */
+struct sq_mark {
+	int frame;
+	long long enq_ns;
+	long long key_ns;
+};
+
+extern int sq_init(int max_text);
 extern void sq_fini(void);
 extern void sq_put(struct symbol_struct *sp);
+extern void sq_put_key(struct symbol_struct *sp, long long key_ns);
+extern int sq_put_text(const char *text, long long key_ns);
+extern int sq_busy(void);
+extern void sq_drop_filler(void);
 extern struct sqe_struct *q_get(void);
-extern void get_period(unsigned char *buf, int len);
+extern void get_period(float *buf, int frames);
+extern int get_period_marked(float *buf, int frames, struct sq_mark *marks,
+	int max_marks);
 
 #endif
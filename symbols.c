@@ -18,141 +18,172 @@
 #include <string.h>
 #include <unistd.h>
 #include <math.h>
-#include <sys/stat.h>
 #include <assert.h>
 
 #include "config.h"
 #include "morse.h"
+#include "sampler.h"
 #include "alsa.h"
 #include "symbols.h"
+#include "synth.h"
 
-#define N_SQ	64
+struct symbol_bank symbols;
 
-struct symbol_struct dit_symbol;
-struct symbol_struct dah_symbol;
-struct symbol_struct gap_symbol;
-struct symbol_struct bad_symbol;
-
-static void generate_symbol(struct symbol_struct *p, int units, int silent_flag)
+static int generate_symbol(struct symbol_bank *bp, struct symbol_struct *p,
+	int units, int silent_flag)
 {
-	double a;
-	double da;
-	double volume;
-	short *pcm;
+	const struct keying_struct *kp = &bp->key;
+	struct tone_struct tone;
+	float *pcm;
 	int samples;
-	int rise_sample;
-	int fall_sample;
-	int i;
-
-	da = 2.0 * M_PI * settings.tone / settings.sample_rate;
 
-	samples = units * settings.sample_rate * UNIT_MS_FROM_WPM(settings.wpm) / 1000.0 + 0.5;
-	rise_sample = settings.sample_rate * settings.rise_ms / 1000.0 + 0.5;
-	fall_sample = samples - rise_sample;
+	samples = units * kp->sample_rate * UNIT_MS_FROM_WPM(kp->wpm) / 1000.0 + 0.5;
 
-	pcm = calloc(samples, settings.n_chans * sizeof(short));
-	assert(pcm);
+	pcm = calloc(samples, sizeof(float));
+	if (pcm == NULL)
+		return -1;
 
 	if (silent_flag)
 		goto done;
 
-	volume = settings.volume * 32000.0;
-	a = 0.0;
-	for (i = 0; i < samples; i++) {
-		double s;
-
-		s = volume * sin(a);
-
-		if (i < rise_sample)
-			s *= (double)i / (double)rise_sample;
-		else if (i >= fall_sample)
-			s *= (double)((samples - 1) - i) / (double)rise_sample;
-
-		pcm[i] = s;
-
-		a += da;
-		while (a > (2.0 * M_PI))
-			a -= 2.0 * M_PI;
-	}
+	tone.freq = kp->tone;
+	tone.sample_rate = kp->sample_rate;
+	tone.volume = kp->volume;
+	tone.env = &bp->envelope;
+	synth_tone(pcm, samples, &tone);
 done:
 	p->pcm = pcm;
 	p->samples = samples;
 	p->units = units;
+
+	return 0;
 }
 
-static void generate_bad_symbol(const char *fn)
+/*
+ * Pre-render every cw[] entry, including the gap before
+ * each DIT and DAH, into one contiguous arena so that a
+ * character is queued and played as a single entry.
+ */
+static int generate_cw_symbols(struct symbol_bank *bp)
 {
-	FILE *fp;
-	char hdr[44];
-	struct stat sb;
-	short *pcm;
-	int samples;
-	int len;
-	int n;
-	int rc;
-
-	rc = stat(fn, &sb);
-	assert(rc == 0);
-
-	len = sb.st_size;
-	assert(len >= sizeof(hdr));
-
-	fp = fopen(fn, "r");
-	assert(fp);
+	struct symbol_struct *element[2];
+	struct symbol_struct *sp;
+	struct symbol_struct *ep;
+	struct symbol_struct *gp;
+	float *pcm;
+	size_t len;
+	int i;
+	int k;
 
-	n = fread(hdr, 1, sizeof(hdr), fp);
-	assert(n == sizeof(hdr));
-	len -= n;
+	bp->chars = calloc(n_cw, sizeof(*bp->chars));
+	if (bp->chars == NULL)
+		return -1;
 
-	pcm = malloc(len);
-	assert(pcm);
+	element[0] = &bp->dit;
+	element[1] = &bp->dah;
 
-	n = fread(pcm, 1, len, fp);
-	assert(n == len);
-	samples = len / ((int)sizeof(short) * 2);
+	/* size the arena */
+	gp = &bp->gap;
+	len = 0;
+	for (i = 0; i < n_cw; i++) {
+		sp = &bp->chars[i];
+		for (k = 0; k < cw[i].len; k++) {
+			ep = element[(cw[i].bits >> k) & 1];
+			sp->samples += gp->samples + ep->samples;
+			sp->units += gp->units + ep->units;
+		}
+		len += sp->samples;
+	}
 
-	bad_symbol.pcm = pcm;
-	bad_symbol.samples = samples;
-	bad_symbol.units = 0;
+	bp->arena = malloc(len * sizeof(float));
+	if (bp->arena == NULL)
+		return -1;
 
-	fclose(fp);
+	pcm = bp->arena;
+	for (i = 0; i < n_cw; i++) {
+		sp = &bp->chars[i];
+		sp->pcm = pcm;
+		for (k = 0; k < cw[i].len; k++) {
+			ep = element[(cw[i].bits >> k) & 1];
+			memcpy(pcm, gp->pcm, gp->samples * sizeof(float));
+			pcm += gp->samples;
+			memcpy(pcm, ep->pcm, ep->samples * sizeof(float));
+			pcm += ep->samples;
+		}
+	}
+	return 0;
 }
 
-static void free_symbols(void)
+void keying_from_settings(struct keying_struct *kp)
 {
-	if (gap_symbol.pcm) {
-		free(gap_symbol.pcm);
-		gap_symbol.pcm = NULL;
-	}
-	if (dah_symbol.pcm) {
-		free(dah_symbol.pcm);
-		dah_symbol.pcm = NULL;
-	}
-	if (dit_symbol.pcm) {
-		free(dit_symbol.pcm);
-		dit_symbol.pcm = NULL;
-	}
+	memset(kp, 0, sizeof(*kp));
+	kp->wpm = settings.wpm;
+	kp->tone = settings.tone;
+	kp->volume = settings.volume;
+	kp->rise_ms = settings.rise_ms;
+	kp->sample_rate = settings.sample_rate;
+	kp->envelope = settings.envelope;
 }
 
-static int generate_symbols(void)
+void bank_destroy(struct symbol_bank *bp)
 {
-	free_symbols();
+	free(bp->chars);
+	free(bp->arena);
+	free(bp->space.pcm);
+	free(bp->letter.pcm);
+	free(bp->gap.pcm);
+	free(bp->dah.pcm);
+	free(bp->dit.pcm);
+	envelope_destroy(&bp->envelope);
+	memset(bp, 0, sizeof(*bp));
+}
 
-	generate_symbol(&dit_symbol, 1, 0);
-	generate_symbol(&dah_symbol, 3, 0);
-	generate_symbol(&gap_symbol, 1, 1);
-	generate_bad_symbol("wrong.wav");
+/*
+ * Render a complete set of symbols for one keying.  The bank
+ * is never modified afterwards, so it can be shared freely.
+ */
+int bank_create(struct symbol_bank *bp, const struct keying_struct *kp)
+{
+	int rise;
+	int rc;
 
-	return 0;
+	memset(bp, 0, sizeof(*bp));
+	bp->key = *kp;
+
+	do {
+		/* one envelope table is shared by every symbol */
+		rise = kp->sample_rate * kp->rise_ms / 1000.0 + 0.5;
+		rc = envelope_create(&bp->envelope, kp->envelope, rise);
+		if (rc) break;
+
+		rc = generate_symbol(bp, &bp->dit, 1, 0);
+		if (rc) break;
+		rc = generate_symbol(bp, &bp->dah, 3, 0);
+		if (rc) break;
+		rc = generate_symbol(bp, &bp->gap, 1, 1);
+		if (rc) break;
+		rc = generate_symbol(bp, &bp->letter, 2, 1);
+		if (rc) break;
+		rc = generate_symbol(bp, &bp->space, 7, 1);
+		if (rc) break;
+		rc = generate_cw_symbols(bp);
+		if (rc) break;
+	} while (0);
+
+	if (rc)
+		bank_destroy(bp);
+
+	return rc;
 }
 
 int symbols_create(void)
 {
-	dit_symbol.pcm = NULL;
-	dah_symbol.pcm = NULL;
-	gap_symbol.pcm = NULL;
+	struct keying_struct key;
+	int rc;
 
-	generate_symbols();
+	keying_from_settings(&key);
+	rc = bank_create(&symbols, &key);
+	assert(rc == 0);
 
 #if 0
 	FILE *fp;
@@ -160,20 +191,20 @@ int symbols_create(void)
 
 	fp = fopen("dit.raw", "w");
 	assert(fp);
-	n = fwrite(dit_symbol.pcm, n_chans * sizeof(short), dit_symbol.samples, fp);
-	assert(n == dit_symbol.samples);
+	n = fwrite(symbols.dit.pcm, sizeof(float), symbols.dit.samples, fp);
+	assert(n == symbols.dit.samples);
 	fclose(fp);
 
 	fp = fopen("dah.raw", "w");
 	assert(fp);
-	n = fwrite(dah_symbol.pcm, n_chans * sizeof(short), dah_symbol.samples, fp);
-	assert(n == dah_symbol.samples);
+	n = fwrite(symbols.dah.pcm, sizeof(float), symbols.dah.samples, fp);
+	assert(n == symbols.dah.samples);
 	fclose(fp);
 
 	fp = fopen("gap.raw", "w");
 	assert(fp);
-	n = fwrite(gap_symbol.pcm, n_chans * sizeof(short), gap_symbol.samples, fp);
-	assert(n == gap_symbol.samples);
+	n = fwrite(symbols.gap.pcm, sizeof(float), symbols.gap.samples, fp);
+	assert(n == symbols.gap.samples);
 	fclose(fp);
 #endif
 	return 0;
@@ -181,26 +212,48 @@ int symbols_create(void)
 
 void symbols_destroy(void)
 {
-	free_symbols();
+	bank_destroy(&symbols);
 }
 
 /*
- * Choose a symbol randomly based on the symbol weights.
+ * The chooser mirrors cw[].weight in a Fenwick tree, so a draw
+ * or a weight change costs O(log n) rather than two passes over
+ * the whole alphabet.  Weights must be changed through
+ * symbol_reweight() once chooser_init() has run.
  */
-int symbol_chooser(void)
+static struct sampler_struct chooser;
+
+int chooser_init(void)
 {
 	int i;
-	float sum;
-	float rand;
 
-	/* find the total weight */
-	sum = 0.0;
+	/* negative weights are not allowed */
 	for (i = 0; i < n_cw; i++) {
-		/* negative weights are not allowed */
 		if (cw[i].weight < 0.0)
 			cw[i].weight = 0.0;
-		sum += cw[i].weight;
 	}
+	return sampler_init(&chooser, &cw[0].weight, n_cw, sizeof(cw[0]));
+}
+
+void chooser_fini(void)
+{
+	sampler_fini(&chooser);
+}
+
+void symbol_reweight(int sym, float scale)
+{
+	cw[sym].weight *= scale;
+	sampler_set(&chooser, sym, cw[sym].weight);
+}
+
+/*
+ * Choose a symbol randomly based on the symbol weights.
+ */
+int symbol_chooser(void)
+{
+	double sum;
+
+	sum = sampler_total(&chooser);
 
 	/*
 	 * If the weights of all symbols are zero,
@@ -210,21 +263,21 @@ int symbol_chooser(void)
 		return (lrand48() % n_cw);
 
 	/* pick a random point within the weight range */
-	rand = drand48() * sum;
+	return sampler_find(&chooser, drand48() * sum);
+}
 
-	/* locate the symbol containing that point */
-	sum = 0.0;
-	for (i = 0; i < n_cw; i++) {
-		sum += cw[i].weight;
-		if (rand < sum)
-			break;
-	}
-	/*
-	 * There's a slight chance of exceeding the range due
-	 * to rounding, but it's not statistally significant.
-	 */
-	if (i >= n_cw)
-		i = n_cw - 1;
+/*
+ * Reentrant symbol_chooser() with a private random state,
+ * for threads that render in parallel.  The chooser is only
+ * read, so no weights may change meanwhile.
+ */
+int symbol_chooser_r(unsigned short xsubi[3])
+{
+	double sum;
+
+	sum = sampler_total(&chooser);
+	if (sum == 0.0)
+		return (nrand48(xsubi) % n_cw);
 
-	return i;
+	return sampler_find(&chooser, erand48(xsubi) * sum);
 }
@@ -15,19 +15,52 @@
 #ifndef _SYMBOLS_H_
 #define _SYMBOLS_H_
 
+#include "synth.h"
+
 struct symbol_struct {
-	short *pcm;
+	float *pcm;
 	int samples;
 	int units;
 };
 
-extern struct symbol_struct dit_symbol;
-extern struct symbol_struct dah_symbol;
-extern struct symbol_struct gap_symbol;
-extern struct symbol_struct bad_symbol;
+/*
+ * Everything that determines how the symbols sound
+ */
+struct keying_struct {
+	double wpm;
+	double tone;
+	double volume;
+	double rise_ms;
+	double sample_rate;
+	int envelope;
+};
+
+/*
+ * A complete set of rendered symbols for one keying
+ */
+struct symbol_bank {
+	struct keying_struct key;
+	struct envelope_struct envelope;
+	struct symbol_struct dit;
+	struct symbol_struct dah;
+	struct symbol_struct gap;	/* 1 unit, between elements */
+	struct symbol_struct letter;	/* 2 more units, between letters */
+	struct symbol_struct space;	/* 7 units, between words */
+	struct symbol_struct *chars;	/* one per cw[] entry */
+	float *arena;			/* pcm for all of chars[] */
+};
+
+extern struct symbol_bank symbols;
 
+extern void keying_from_settings(struct keying_struct *kp);
+extern int bank_create(struct symbol_bank *bp, const struct keying_struct *kp);
+extern void bank_destroy(struct symbol_bank *bp);
 extern int symbols_create(void);
 extern void symbols_destroy(void);
+extern int chooser_init(void);
+extern void chooser_fini(void);
+extern void symbol_reweight(int sym, float scale);
 extern int symbol_chooser(void);
+extern int symbol_chooser_r(unsigned short xsubi[3]);
 
 #endif
@@ -0,0 +1,381 @@
+/*
+ * Copyright (C) 2018 by Ross Wille. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * COPYING file for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "synth.h"
+
+#define LANES		4
+#define FULL_SCALE	(32000.0 / 32768.0)	/* headroom kept from the 16-bit days */
+#define N_ENVELOPES	((int)(sizeof(envelope_names) / sizeof(envelope_names[0])))
+
+typedef double v4df __attribute__((vector_size(LANES * sizeof(double))));
+typedef float v4sf __attribute__((vector_size(LANES * sizeof(float))));
+typedef float v8sf __attribute__((vector_size(8 * sizeof(float))));
+typedef int v8si __attribute__((vector_size(8 * sizeof(int))));
+
+/*
+ * Build the kernel for both AVX2 and baseline SSE2;
+ * the loader picks the best one for the running CPU.
+ */
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SYNTH_KERNEL	__attribute__((target_clones("avx2", "default")))
+#else
+#define SYNTH_KERNEL
+#endif
+
+static const char *envelope_names[] = {
+	[ENV_LINEAR] = "linear",
+	[ENV_COSINE] = "cosine",
+	[ENV_BLACKMAN] = "blackman",
+};
+
+int envelope_lookup(const char *name)
+{
+	int i;
+
+	for (i = 0; i < N_ENVELOPES; i++) {
+		if (strcmp(name, envelope_names[i]) == 0)
+			return i;
+	}
+	return -1;
+}
+
+const char *envelope_name(int shape)
+{
+	if ((shape < 0) || (shape >= N_ENVELOPES))
+		return "?";
+	return envelope_names[shape];
+}
+
+/*
+ * Build the rising half of the keying envelope.  The falling
+ * half is the same table read backwards.
+ */
+int envelope_create(struct envelope_struct *ep, int shape, int len)
+{
+	double x;
+	int i;
+
+	ep->ramp = NULL;
+	ep->len = len;
+	ep->shape = shape;
+	if (len == 0)
+		return 0;
+
+	ep->ramp = malloc(len * sizeof(double));
+	if (ep->ramp == NULL)
+		return -1;
+
+	for (i = 0; i < len; i++) {
+		switch (shape) {
+		case ENV_COSINE:
+			ep->ramp[i] = 0.5 * (1.0 - cos(M_PI * i / len));
+			break;
+		case ENV_BLACKMAN:
+			/* 4-term Blackman-Harris window, first half */
+			x = M_PI * i / len;
+			ep->ramp[i] = 0.35875 - 0.48829 * cos(x) +
+				0.14128 * cos(2.0 * x) - 0.01168 * cos(3.0 * x);
+			break;
+		case ENV_LINEAR:
+		default:
+			ep->ramp[i] = (double)i / (double)len;
+			break;
+		}
+	}
+	return 0;
+}
+
+void envelope_destroy(struct envelope_struct *ep)
+{
+	free(ep->ramp);
+	ep->ramp = NULL;
+	ep->len = 0;
+}
+
+/*
+ * Envelope gain for sample i of a symbol
+ */
+static inline double envelope_gain(const struct envelope_struct *ep, int i, int samples)
+{
+	if (i < ep->len)
+		return ep->ramp[i];
+	if (i >= samples - ep->len)
+		return ep->ramp[(samples - 1) - i];
+	return 1.0;
+}
+
+/*
+ * Render a keyed sine tone into pcm[], full scale +/-1.0.
+ *
+ * Each lane of the vector holds one of LANES consecutive samples,
+ * and the lanes are advanced together by rotating their (sin, cos)
+ * pairs through LANES * da.  Only two trig calls are needed per
+ * SYNTH_BLOCK samples instead of one per sample.  The envelope is
+ * a table lookup and is only applied in the rise and fall blocks.
+ */
+SYNTH_KERNEL
+void synth_tone(float *pcm, int samples, const struct tone_struct *tp)
+{
+	const struct envelope_struct *ep = tp->env;
+	double da;
+	double volume;
+	v4df ls;
+	v4df lc;
+	v4df s4;
+	v4df c4;
+	int i;
+	int k;
+
+	da = 2.0 * M_PI * tp->freq / tp->sample_rate;
+	volume = tp->volume * FULL_SCALE;
+
+	for (k = 0; k < LANES; k++) {
+		ls[k] = sin(k * da);
+		lc[k] = cos(k * da);
+	}
+	s4 = (v4df){0} + sin(LANES * da);
+	c4 = (v4df){0} + cos(LANES * da);
+
+	for (i = 0; i < samples; i += SYNTH_BLOCK) {
+		double ph;
+		double sp;
+		double cp;
+		v4df s;
+		v4df c;
+		int n;
+		int j;
+
+		n = samples - i;
+		if (n > SYNTH_BLOCK)
+			n = SYNTH_BLOCK;
+
+		/* resync all lanes to the exact phase of sample i */
+		ph = fmod(i * da, 2.0 * M_PI);
+		sp = sin(ph);
+		cp = cos(ph);
+		s = sp * lc + cp * ls;
+		c = cp * lc - sp * ls;
+
+		for (j = 0; j < n; j += LANES) {
+			v4df y;
+			v4df t;
+			v4sf h;
+
+			y = s * volume;
+			if ((i + j < ep->len) || (i + j + LANES > samples - ep->len)) {
+				v4df g;
+
+				/* lanes past the end are never stored */
+				for (k = 0; k < LANES; k++)
+					g[k] = (i + j + k < samples) ?
+						envelope_gain(ep, i + j + k, samples) : 0.0;
+				y *= g;
+			}
+
+			h = __builtin_convertvector(y, v4sf);
+			if (j + LANES <= n)
+				memcpy(&pcm[i + j], &h, sizeof(h));
+			else
+				memcpy(&pcm[i + j], &h, (n - j) * sizeof(float));
+
+			t = s * c4 + c * s4;
+			c = c * c4 - s * s4;
+			s = t;
+		}
+	}
+}
+
+/*
+ * Per-channel gains for a pan position, -1.0 (left) to 1.0
+ * (right).  Only the first two channels are panned.
+ */
+void synth_pan_gains(float *gain, int n_chans, double pan)
+{
+	int c;
+
+	for (c = 0; c < n_chans; c++)
+		gain[c] = 1.0;
+
+	if (n_chans >= 2) {
+		if (pan > 0.0)
+			gain[0] = 1.0 - pan;
+		else if (pan < 0.0)
+			gain[1] = 1.0 + pan;
+	}
+}
+
+/*
+ * Expand mono samples into interleaved frames of n_chans
+ * channels, scaling each channel by gain[].
+ */
+SYNTH_KERNEL
+void synth_fanout(float *out, const float *in, int frames, int n_chans,
+	const float *gain)
+{
+	int unity;
+	int i;
+	int c;
+
+	unity = 1;
+	for (c = 0; c < n_chans; c++) {
+		if (gain[c] != 1.0f)
+			unity = 0;
+	}
+
+	if ((n_chans == 1) && unity) {
+		memcpy(out, in, frames * sizeof(float));
+		return;
+	}
+
+	i = 0;
+	if (n_chans == 2) {
+		const v8si lo = {0, 0, 1, 1, 2, 2, 3, 3};
+		const v8si hi = {4, 4, 5, 5, 6, 6, 7, 7};
+		v8sf g = {gain[0], gain[1], gain[0], gain[1],
+			  gain[0], gain[1], gain[0], gain[1]};
+
+		for (; i + 8 <= frames; i += 8) {
+			v8sf x;
+			v8sf a;
+			v8sf b;
+
+			memcpy(&x, &in[i], sizeof(x));
+			a = __builtin_shuffle(x, lo);
+			b = __builtin_shuffle(x, hi);
+			if (!unity) {
+				a *= g;
+				b *= g;
+			}
+			memcpy(&out[2 * i], &a, sizeof(a));
+			memcpy(&out[2 * i + 8], &b, sizeof(b));
+		}
+	}
+
+	for (; i < frames; i++) {
+		for (c = 0; c < n_chans; c++)
+			out[i * n_chans + c] = in[i] * gain[c];
+	}
+}
+
+#ifdef MAIN
+#include <time.h>
+
+/*
+ * The original per-sample generate_symbol() loop, kept as the
+ * reference for accuracy and speed.
+ */
+static void synth_tone_ref(float *pcm, int samples, const struct tone_struct *tp)
+{
+	double a;
+	double da;
+	double volume;
+	int rise;
+	int i;
+
+	da = 2.0 * M_PI * tp->freq / tp->sample_rate;
+	volume = tp->volume * FULL_SCALE;
+	rise = tp->env->len;
+	a = 0.0;
+	for (i = 0; i < samples; i++) {
+		double s;
+
+		s = volume * sin(a);
+
+		if (i < rise)
+			s *= (double)i / (double)rise;
+		else if (i >= samples - rise)
+			s *= (double)((samples - 1) - i) / (double)rise;
+
+		pcm[i] = s;
+
+		a += da;
+		while (a > (2.0 * M_PI))
+			a -= 2.0 * M_PI;
+	}
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1.0e9;
+}
+
+static double bench(void (*fn)(float *, int, const struct tone_struct *),
+	float *pcm, int samples, int reps, const struct tone_struct *tp)
+{
+	double t;
+	int i;
+
+	t = now();
+	for (i = 0; i < reps; i++)
+		fn(pcm, samples, tp);
+	t = now() - t;
+
+	return (double)samples * reps / t;
+}
+
+int main(int argc, char *argv[])
+{
+	struct envelope_struct env;
+	struct tone_struct tone;
+	float *ref;
+	float *pcm;
+	double ref_rate;
+	double rate;
+	double maxdiff;
+	int samples;
+	int reps;
+	int i;
+
+	tone.freq = (argc > 1) ? atof(argv[1]) : 800.0;
+	tone.sample_rate = 48000.0;
+	tone.volume = 0.8;
+	tone.env = &env;
+	envelope_create(&env, ENV_LINEAR, 240);
+	samples = 3 * 48000;
+	reps = (argc > 2) ? atoi(argv[2]) : 200;
+
+	ref = calloc(samples, sizeof(float));
+	pcm = calloc(samples, sizeof(float));
+
+	synth_tone_ref(ref, samples, &tone);
+	synth_tone(pcm, samples, &tone);
+	maxdiff = 0.0;
+	for (i = 0; i < samples; i++) {
+		if (fabs(ref[i] - pcm[i]) > maxdiff)
+			maxdiff = fabs(ref[i] - pcm[i]);
+	}
+
+	ref_rate = bench(synth_tone_ref, ref, samples, reps, &tone);
+	rate = bench(synth_tone, pcm, samples, reps, &tone);
+
+	printf("tone %0.0lf Hz, %d samples x %d\n", tone.freq, samples, reps);
+	printf("  reference: %8.2f Msamples/s\n", ref_rate / 1.0e6);
+	printf("     kernel: %8.2f Msamples/s (%0.1fx)\n", rate / 1.0e6, rate / ref_rate);
+	printf("   max diff: %0.3f LSB (16-bit)\n", maxdiff * 32768.0);
+
+	free(ref);
+	free(pcm);
+	envelope_destroy(&env);
+
+	return 0;
+}
+#endif
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2018 by Ross Wille. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * COPYING file for more details.
+ */
+
+#ifndef _SYNTH_H_
+#define _SYNTH_H_
+
+/*
+ * The oscillator is resynchronized to the exact phase at the
+ * start of every block, so rounding never accumulates.
+ */
+#define SYNTH_BLOCK		64
+
+/*
+ * Keying envelope shapes
+ */
+#define ENV_LINEAR		0
+#define ENV_COSINE		1
+#define ENV_BLACKMAN		2
+
+struct envelope_struct {
+	double *ramp;		/* rising half of the envelope */
+	int len;		/* rise/fall time (samples) */
+	int shape;
+};
+
+struct tone_struct {
+	double freq;		/* tone frequency (Hz) */
+	double sample_rate;	/* samples per second */
+	double volume;		/* 0.0 to 1.0 */
+	const struct envelope_struct *env;
+};
+
+extern int envelope_create(struct envelope_struct *ep, int shape, int len);
+extern void envelope_destroy(struct envelope_struct *ep);
+extern int envelope_lookup(const char *name);
+extern const char *envelope_name(int shape);
+extern void synth_tone(float *pcm, int samples, const struct tone_struct *tp);
+extern void synth_pan_gains(float *gain, int n_chans, double pan);
+extern void synth_fanout(float *out, const float *in, int frames, int n_chans,
+	const float *gain);
+
+#endif
@@ -20,12 +20,29 @@
 #include <unistd.h>
 #include <ctype.h>
 #include <assert.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/signalfd.h>
 
 #include "config.h"
 #include "alsa.h"
+#include "audio.h"
+#include "batch.h"
+#include "dict.h"
+#include "feedback.h"
+#include "journal.h"
+#include "latency.h"
 #include "morse.h"
+#include "prof.h"
+#include "reactor.h"
+#include "render.h"
+#include "rt.h"
+#include "rtlog.h"
+#include "stats.h"
+#include "src.h"
 #include "sym-queue.h"
 #include "symbols.h"
+#include "synth.h"
 #include "threads.h"
 #include "tty.h"
 
@@ -33,9 +50,31 @@ struct settings_struct settings;
 int run_flag;
 int help_flag;
 
+static char *batch_fn;
+static char *compile_fn;
+static char *dict_fn;
+static int batch_jobs;
+static char *render_fn;
+static int render_count = 100;
+static long seed;
+static int seed_flag;
+static char *trace_fn;
+
 static pthread_t alsa_thread;
 static pthread_t worker_thread;
 
+static struct reactor_struct reactor;
+static int drill_sym;			/* the symbol being asked */
+static long long drill_ns;		/* when it was queued */
+static int drill_word;			/* or the dictionary entry */
+static char answer[DICT_MAX_LEN + 1];	/* the word typed so far */
+static int answer_len;
+static char prosign[8];			/* letters typed after '<' */
+static int prosign_len = -1;		/* or -1 */
+
+/* SIGUSR1 prints the latency figures so far */
+static const int reactor_sigs[] = {SIGINT, SIGTERM, SIGHUP, SIGUSR1};
+
 static int worker_init(void)
 {
 	return 0;
@@ -45,48 +84,46 @@ static void worker_fini(void)
 {
 }
 
+/*
+ * The worker is the render thread: it keeps the render-ahead
+ * ring full so the audio thread never synthesizes or locks.
+ * Between periods it writes out the rtlog; the ring ahead of
+ * the audio thread covers the time that takes.
+ */
 static void *worker_task(void *cookie)
 {
-	usleep(THREAD_STARTUP_DELAY_US);
-
+	rt_prefault_stack();
 	while (run_flag) {
-		sleep(1);
+		audio_render();
+		rtlog_drain(stderr);
 	}
 	return NULL;
 }
 
+/*
+ * Both threads start with the main thread's policy and are
+ * then raised.  Refusal is not fatal: rt_report() says what
+ * was granted.  Returns the pthread_create() error, with no
+ * thread left running.
+ */
 static int start_threads(void)
 {
-	pthread_attr_t io_attr;
-	pthread_attr_t wk_attr;
-	struct sched_param io_param;
-	struct sched_param wk_param;
 	int rc;
 
-	pthread_attr_init(&io_attr);
-	pthread_attr_getschedparam(&io_attr, &io_param);
-	io_param.sched_priority = IO_PRIORITY;
-	pthread_attr_setschedpolicy(&io_attr, IO_SCHED);
-	pthread_attr_setschedparam(&io_attr, &io_param);
-
-	pthread_attr_init(&wk_attr);
-	pthread_attr_getschedparam(&wk_attr, &wk_param);
-	wk_param.sched_priority = WORK_PRIORITY;
-	pthread_attr_setschedpolicy(&wk_attr, WK_SCHED);
-	pthread_attr_setschedparam(&wk_attr, &wk_param);
-
 	do {
-		rc = pthread_create(&worker_thread, &wk_attr, &worker_task, (void *)2);
-		if (rc) break;
-
-		rc = pthread_create(&alsa_thread, &io_attr, &alsa_task, (void *)3);
+		rc = pthread_create(&worker_thread, NULL, &worker_task, (void *)2);
 		if (rc) break;
 
-		rc = pthread_setschedparam(worker_thread, WK_SCHED, &wk_param);
-		if (rc) break;
+		rc = pthread_create(&alsa_thread, NULL, &audio_task, (void *)3);
+		if (rc) {
+			run_flag = 0;
+			audio_stop();
+			pthread_join(worker_thread, NULL);
+			break;
+		}
 
-		rc = pthread_setschedparam(alsa_thread, IO_SCHED, &io_param);
-		if (rc) break;
+		rt_setup_thread(worker_thread, "render", WK_SCHED, WORK_PRIORITY, -1);
+		rt_setup_thread(alsa_thread, "audio", IO_SCHED, IO_PRIORITY, settings.cpu);
 	} while (0);
 
 	return rc;
@@ -98,34 +135,245 @@ static void join_threads(void)
 	pthread_join(alsa_thread, NULL);
 }
 
-static void queue_cw(int index)
+static void queue_cw(int index, long long key_ns)
+{
+	sq_put_key(&symbols.chars[index], key_ns);
+	audio_resume();
+}
+
+static void queue_feedback(int id, long long key_ns)
 {
-	char *p;
+	if (feedback[id].pcm == NULL)
+		return;
+	sq_put_key(&feedback[id], key_ns);
+	audio_resume();
+}
 
-	for (p = cw[index].cw; *p; p++) {
-		switch (*p) {
-		case '.':
-			sq_put(&gap_symbol);
-			sq_put(&dit_symbol);
-			break;
-		case '-':
-			sq_put(&gap_symbol);
-			sq_put(&dah_symbol);
-			break;
-		default:
-			break;
+static long long key_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void queue_word(int index, long long key_ns)
+{
+	if (sq_put_text(dict_entry(&dictionary, index), key_ns) < 0) {
+		printf("Busy; press Enter to hear it again\r\n");
+		return;
+	}
+	audio_resume();
+}
+
+static void drill_next(long long key_ns)
+{
+	drill_ns = key_time();
+	if (dictionary.n) {
+		drill_word = dict_chooser(&dictionary);
+		DPRINTF("Chose word '%s'\r\n", dict_entry(&dictionary, drill_word));
+		answer_len = 0;
+		queue_word(drill_word, key_ns);
+		return;
+	}
+	drill_sym = symbol_chooser();
+	DPRINTF("Chose symbol '%s' Weight=%0.5f\r\n", cw[drill_sym].symbol, cw[drill_sym].weight);
+	queue_cw(drill_sym, key_ns);
+}
+
+static void log_answer(int sym, int result, int key, int ans, float scale,
+	long long key_ns)
+{
+	struct journal_rec rec;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.sym = sym;
+	rec.answer = ans;
+	rec.key = key;
+	rec.result = result;
+	rec.react_ms = (key_ns - drill_ns) / 1.0e6;
+	rec.weight = cw[sym].weight;
+	rec.scale = scale;
+	journal_append(&rec);
+}
+
+/*
+ * In dictionary mode the answer is typed out and checked as a
+ * whole when Enter is pressed; Enter on its own repeats.
+ */
+static void on_word_key(int c, long long key_ns)
+{
+	const char *word = dict_entry(&dictionary, drill_word);
+
+	if ((c == '\r') || (c == '\n')) {
+		if (answer_len && (answer[answer_len - 1] == ' '))
+			answer_len--;
+		if (answer_len == 0) {
+			queue_feedback(FB_REPEAT, key_ns);
+			queue_word(drill_word, key_ns);
+			return;
+		}
+		answer[answer_len] = '\0';
+		if (strcmp(answer, word) == 0) {
+			queue_feedback(FB_RIGHT, key_ns);
+			printf("\r\nRight! %s\r\n", word);
+		}
+		else {
+			queue_feedback(FB_WRONG, key_ns);
+			printf("\r\nWrong! %s\r\n", word);
 		}
+		drill_next(key_ns);
+		return;
+	}
+
+	if ((c == '\b') || (c == 0x7f)) {
+		if (answer_len) {
+			answer_len--;
+			printf("\b \b");
+		}
+	}
+	else {
+		c = toupper(c);
+		if (answer_len >= DICT_MAX_LEN)
+			return;
+		if (c == ' ') {
+			if ((answer_len == 0) || (answer[answer_len - 1] == ' '))
+				return;
+		}
+		else if ((c != '<') && (c != '>') && (cw_lookup(c) < 0))
+			return;
+		answer[answer_len++] = c;
+		putchar(c);
+	}
+	fflush(stdout);
+}
+
+/*
+ * The training loop, one key at a time.  A prosign is answered
+ * with '<' and its letters, e.g. "<AR".
+ */
+static void on_key(struct reactor_struct *rp, int fd, void *cookie)
+{
+	unsigned char kbd_buf[16];
+	long long key_ns;
+	int sym = drill_sym;
+	int ans;
+	int n;
+	int c;
+
+	n = tty_read(kbd_buf, 1);
+	key_ns = key_time();
+	if (n == 0)
+		return;
+	if (n < 0) {
+		printf("TTY error\r\n");
+		reactor_stop(rp);
+		return;
+	}
+
+	c = kbd_buf[0];
+	if ((c == '\033') || (c == '\003')) {
+		printf("Quitting\r\n");
+		reactor_stop(rp);
+		return;
+	}
+	if (dictionary.n) {
+		on_word_key(c, key_ns);
+		return;
+	}
+	if (c == ' ') {
+		symbol_reweight(sym, AGAIN_SCALE);
+		log_answer(sym, JR_REPEAT, c, -1, AGAIN_SCALE, key_ns);
+		queue_feedback(FB_REPEAT, key_ns);
+		queue_cw(sym, key_ns);
+		return;
+	}
+
+	if (c == '<') {
+		prosign_len = 0;
+		return;
+	}
+	if (c == '>')
+		return;
+	if (prosign_len >= 0) {
+		prosign[prosign_len++] = c;
+		ans = cw_prosign(prosign, prosign_len);
+		if ((ans == CW_PARTIAL) && (prosign_len < (int)sizeof(prosign)))
+			return;
+		prosign_len = -1;
+	}
+	else
+		ans = cw_lookup(c);
+
+	if (ans == sym) {
+		symbol_reweight(sym, RIGHT_SCALE);
+		log_answer(sym, JR_RIGHT, c, ans, RIGHT_SCALE, key_ns);
+		queue_feedback(FB_RIGHT, key_ns);
+		printf("Right! %s\r\n", cw[sym].symbol);
+	}
+	else {
+		symbol_reweight(sym, WRONG_SCALE);
+		log_answer(sym, JR_WRONG, c, ans, WRONG_SCALE, key_ns);
+		queue_feedback(FB_WRONG, key_ns);
+		printf("Wrong! %s\r\n", cw[sym].symbol);
+	}
+	drill_next(key_ns);
+}
+
+static void on_signal(struct reactor_struct *rp, int fd, void *cookie)
+{
+	struct signalfd_siginfo si;
+
+	if (read(fd, &si, sizeof(si)) != sizeof(si))
+		return;
+	if (si.ssi_signo == SIGUSR1) {
+		latency_report(stderr);
+		return;
 	}
+	printf("Quitting (%s)\r\n", strsignal(si.ssi_signo));
+	reactor_stop(rp);
+}
+
+static void on_audio_stopped(struct reactor_struct *rp, int fd, void *cookie)
+{
+	reactor_drain(fd);
+	reactor_stop(rp);
 }
 
 static void show_help(void)
 {
 	printf("cw-trainer [options...]\n");
+	printf("cw-trainer stats [options...] [HISTORY...]\n\n");
+	printf("  -a, --ahead=#\n\t\tPeriods to render ahead of playback, 1 to %d [default=%d]\n\n",
+		RING_SLOTS, settings.ahead);
+	printf("  -A, --adaptive\n\t\tAdapt the render-ahead depth to this host's scheduling\n\n");
+	printf("  -B, --batch=MANIFEST\n\t\tRender every job in MANIFEST to its own WAV file\n\n");
+	printf("  -C, --cpu=#\n\t\tPin the audio thread to this CPU [default=any]\n\n");
 	printf("  -c, --channels=#\n\t\tNumber of audio channels [default=%d]\n\n", settings.n_chans);
+	printf("  -n, --count=#\n\t\tNumber of characters for --render [default=%d]\n\n", render_count);
 	printf("  -D, --device=NAME\n\t\tSelect PCM by name [default=%s]\n\n", settings.alsadev);
+	printf("  -d, --dict=FILE\n\t\tDrill words from a compiled dictionary; type each word, then Enter\n\n");
+	printf("  -e, --envelope=SHAPE\n\t\tKeying envelope: linear, cosine or blackman [default=%s]\n\n",
+		envelope_name(settings.envelope));
+	printf("  -f, --feedback=NAME=FILE\n\t\tWAV file for the wrong, right or repeat sound; no FILE for none\n"
+		"\t\t[default=wrong=wrong.wav]\n\n");
+	printf("  -F, --format=FMT\n\t\tSample format: S16_LE, S24_3LE, S32_LE or FLOAT_LE; ALSA falls\n"
+		"\t\tback to the best the device takes [default=S16_LE, or best for ALSA]\n\n");
 	printf("  -h, --help\n\t\tHelp: show syntax\n\n");
+	printf("  -i, --idle\n\t\tPause the output while waiting for a key\n\n");
+	printf("  -j, --jobs=#\n\t\tThreads for --batch [default=one per core]\n\n");
+	printf("  -k, --compile=LIST\n\t\tCompile a word list into the --dict file, and exit\n\n");
+	printf("  -m, --mmap\n\t\tRender directly into the mmap'ed PCM buffer\n\n");
+	printf("  -o, --output=SINK\n\t\tAudio output: alsa[:PCM], null[:fast], wav:FILE or stdout [default=%s]\n\n",
+		settings.output);
+	printf("  -p, --pan=#\n\t\tStereo pan, -1.0 (left) to 1.0 (right) [default=%0.1lf]\n\n", settings.pan);
+	printf("  -q, --resample=QUALITY\n\t\tResampler: fast, medium or best [default=%s]\n\n",
+		src_quality_name(settings.src_quality));
+	printf("  -R, --render=FILE\n\t\tRender a drill to a WAV file, faster than real time\n\n");
 	printf("  -r, --rise=#\n\t\tRise time (milliseconds) [default=%0.1lf]\n\n", settings.rise_ms);
+	printf("  -S, --seed=#\n\t\tRandom seed, for a repeatable drill\n\n");
 	printf("  -s, --sample-rate=#<hz>\n\t\tSample rate [default=%0.0lf]\n\n", settings.sample_rate);
+	printf("  -T, --trace=FILE\n\t\tWrite a Chrome trace-event timeline of the session\n\n");
 	printf("  -t, --tone=#<hz>\n\t\tTone frequency [default=%0.0lf]\n\n", settings.tone);
 	printf("  -v, --volume=#\n\t\tVolume, 0.0 to 1.0 [default=%0.1lf]\n\n", settings.volume);
 	printf("  -w, --wpm=#\n\t\tWords per Minute [default=%0.1lf]\n\n", settings.wpm);
@@ -133,37 +381,71 @@ static void show_help(void)
 
 int main(int argc, char *argv[])
 {
-	unsigned char kbd_buf[16];
-	int sym;
-	int n;
+	int rc;
 	int c;
 
+	if ((argc > 1) && (strcmp(argv[1], "stats") == 0))
+		return stats_main(argc - 1, argv + 1);
+
+	rtlog_init();
+
 	help_flag = 0;
 	strcpy(settings.alsadev, "hw:0,0");
+	strcpy(settings.output, "alsa");
 	settings.wpm = 13.0;
 	settings.tone = 800.0;
 	settings.volume = 0.8;
 	settings.rise_ms = 5.0;
+	settings.envelope = ENV_COSINE;
 	settings.sample_rate = 48000;
 	settings.n_chans = 2;
+	settings.format = -1;
+	settings.src_quality = SRC_MEDIUM;
+	settings.pan = 0.0;
+	settings.mmap = 0;
+	settings.ahead = DEFAULT_AHEAD;
+	settings.adaptive = 0;
+	settings.idle = 0;
+	settings.cpu = -1;
 
 	config_read();
+	if (journal_replay() < 0)
+		fprintf(stderr, "journal: unreadable or from another build, starting a new one\n");
 
 	while (1) {
 		static struct option long_options[] = {
+			{"adaptive", no_argument, 0, 'A'},
+			{"ahead", required_argument, 0, 'a'},
+			{"batch", required_argument, 0, 'B'},
 			{"channels", required_argument, 0, 'c'},
+			{"compile", required_argument, 0, 'k'},
+			{"count", required_argument, 0, 'n'},
+			{"cpu", required_argument, 0, 'C'},
 			{"device", required_argument, 0, 'D'},
+			{"dict", required_argument, 0, 'd'},
+			{"envelope", required_argument, 0, 'e'},
+			{"feedback", required_argument, 0, 'f'},
+			{"format", required_argument, 0, 'F'},
 			{"help", no_argument, 0, 'h'},
+			{"idle", no_argument, 0, 'i'},
+			{"jobs", required_argument, 0, 'j'},
+			{"mmap", no_argument, 0, 'm'},
+			{"output", required_argument, 0, 'o'},
+			{"pan", required_argument, 0, 'p'},
+			{"render", required_argument, 0, 'R'},
+			{"resample", required_argument, 0, 'q'},
 			{"rise", required_argument, 0, 'r'},
+			{"seed", required_argument, 0, 'S'},
 			{"sample-rate", required_argument, 0, 's'},
 			{"tone", required_argument, 0, 't'},
+			{"trace", required_argument, 0, 'T'},
 			{"volume", required_argument, 0, 'v'},
 			{"wpm", required_argument, 0, 'w'},
 			{0, 0, 0, 0}
 		};
 		int option_index = 0;
 
-		c = getopt_long(argc, argv, "D:ht:v:w:", long_options, &option_index);
+		c = getopt_long(argc, argv, "Aa:B:C:c:D:d:e:f:F:hij:k:mn:o:p:q:R:r:S:s:T:t:v:w:", long_options, &option_index);
 		if (c == -1)
 			break;
 
@@ -176,22 +458,112 @@ int main(int argc, char *argv[])
 				printf(" with arg %s\n", optarg);
 			printf("\n");
 			break;
+		case 'A':
+			settings.adaptive = 1;
+			break;
+		case 'a':
+			settings.ahead = atoi(optarg);
+			if ((settings.ahead < 1) || (settings.ahead > RING_SLOTS)) {
+				printf("invalid render-ahead: %s\n", optarg);
+				exit(1);
+			}
+			break;
+		case 'B':
+			batch_fn = optarg;
+			break;
+		case 'C':
+			settings.cpu = atoi(optarg);
+			if ((settings.cpu < 0) ||
+			    (settings.cpu >= sysconf(_SC_NPROCESSORS_CONF))) {
+				printf("invalid cpu: %s\n", optarg);
+				exit(1);
+			}
+			break;
 		case 'c':
 			settings.n_chans = atoi(optarg);
+			if ((settings.n_chans < 1) || (settings.n_chans > MAX_CHANNELS)) {
+				printf("invalid channel count: %s\n", optarg);
+				exit(1);
+			}
 			break;
 		case 'D':
 			strncpy(settings.alsadev, optarg, sizeof(settings.alsadev));
 			break;
+		case 'd':
+			dict_fn = optarg;
+			break;
+		case 'e':
+			settings.envelope = envelope_lookup(optarg);
+			if (settings.envelope < 0) {
+				printf("invalid envelope: %s\n", optarg);
+				exit(1);
+			}
+			break;
+		case 'f':
+			if (feedback_set(optarg) < 0) {
+				printf("invalid feedback sound: %s\n", optarg);
+				exit(1);
+			}
+			break;
+		case 'F':
+			settings.format = pcm_format_lookup(optarg);
+			if (settings.format < 0) {
+				printf("invalid format: %s\n", optarg);
+				exit(1);
+			}
+			break;
 		case 'h':
 			help_flag = 1;
 			break;
 			
+		case 'i':
+			settings.idle = 1;
+			break;
+		case 'j':
+			batch_jobs = atoi(optarg);
+			break;
+		case 'k':
+			compile_fn = optarg;
+			break;
+		case 'm':
+			settings.mmap = 1;
+			break;
+		case 'n':
+			render_count = atoi(optarg);
+			break;
+		case 'o':
+			snprintf(settings.output, sizeof(settings.output), "%s", optarg);
+			break;
+		case 'p':
+			settings.pan = atof(optarg);
+			if ((settings.pan < -1.0) || (settings.pan > 1.0)) {
+				printf("invalid pan: %s\n", optarg);
+				exit(1);
+			}
+			break;
+		case 'q':
+			settings.src_quality = src_quality_lookup(optarg);
+			if (settings.src_quality < 0) {
+				printf("invalid resampler quality: %s\n", optarg);
+				exit(1);
+			}
+			break;
+		case 'R':
+			render_fn = optarg;
+			break;
 		case 'r':
 			settings.rise_ms = atof(optarg);
 			break;
+		case 'S':
+			seed = atol(optarg);
+			seed_flag = 1;
+			break;
 		case 's':
 			settings.sample_rate = atoi(optarg);
 			break;
+		case 'T':
+			trace_fn = optarg;
+			break;
 		case 't':
 			settings.tone = atof(optarg);
 			break;
@@ -211,66 +583,119 @@ int main(int argc, char *argv[])
 		exit(0);
 	}
 
-	srand48(time(NULL) ^ (getpid() << 16));
+	if (compile_fn) {
+		if (dict_fn == NULL) {
+			fprintf(stderr, "--compile needs --dict=FILE to write\n");
+			exit(1);
+		}
+		exit(dict_compile(compile_fn, dict_fn) ? 1 : 0);
+	}
+	if (dict_fn && (dict_open(&dictionary, dict_fn) < 0))
+		exit(1);
+
+	if (!seed_flag)
+		seed = time(NULL) ^ (getpid() << 16);
+	srand48(seed);
+
+	if (chooser_init() < 0) {
+		fprintf(stderr, "no memory for the symbol chooser\n");
+		exit(1);
+	}
+
+	if (batch_fn)
+		exit(batch_run(batch_fn, batch_jobs) ? 1 : 0);
 
+	if (render_fn) {
+		int rc;
+
+		symbols_create();
+		if (sq_init(dictionary.max_len) < 0) {
+			fprintf(stderr, "no memory for the symbol queue\n");
+			exit(1);
+		}
+		rc = render_session(render_fn, render_count);
+		sq_fini();
+		symbols_destroy();
+		exit(rc ? 1 : 0);
+	}
+
+	/* the sink may change the rate and channels the symbols need */
+	if (audio_init(settings.output) < 0)
+		exit(1);
 	symbols_create();
+	if (feedback_load(settings.sample_rate) < 0) {
+		audio_fini();
+		exit(1);
+	}
+	if (sq_init(dictionary.max_len) < 0) {
+		fprintf(stderr, "no memory for the symbol queue\n");
+		audio_fini();
+		exit(1);
+	}
 	tty_init();
-	sq_init();
-	alsa_init();
 	worker_init();
 
-	run_flag = 1;
-	start_threads();
+	/* before any thread starts, so that they all block the signals */
+	if ((reactor_create(&reactor) < 0) ||
+	    (reactor_signals(&reactor, reactor_sigs, N_ARRAY(reactor_sigs), on_signal, NULL) < 0) ||
+	    (reactor_add(&reactor, tty_fd(), POLLIN, on_key, NULL) < 0) ||
+	    (reactor_add(&reactor, audio_fd(), POLLIN, on_audio_stopped, NULL) < 0)) {
+		perror("reactor");
+		audio_fini();
+		tty_fini();
+		exit(1);
+	}
 
-	while (run_flag) {
-		sym = symbol_chooser();
-		DPRINTF("Chose symbol '%s' Weight=%0.5f\r\n", cw[sym].symbol, cw[sym].weight);
-again:		queue_cw(sym);
-
-		while (1) {
-			n = tty_read(kbd_buf, 1);
-			if (n == 0) {
-				printf("TTY timeout\r\n");
-				usleep(20000);
-				continue;
-			}
-			else if (n < 0) {
-				printf("TTY error\r\n");
-				run_flag = 0;
-			}
-			break;
-		}
-		c = kbd_buf[0];
-		if ((c == '\033') || (c == '\003')) {
-			run_flag = 0;
-			printf("Quitting\r\n");
-			break;
-		}
-		else if (c == ' ') {
-			cw[sym].weight *= AGAIN_SCALE;
-			goto again;
-		}
+	if (prof_init(trace_fn) < 0) {
+		fprintf(stderr, "no memory for the trace\n");
+		trace_fn = NULL;
+	}
 
-		if (toupper(c) == cw[sym].symbol[0]) {
-			cw[sym].weight *= RIGHT_SCALE;
-			printf("Right! %s\r\n", cw[sym].symbol);
-		}
-		else {
-			cw[sym].weight *= WRONG_SCALE;
-			sq_put(&bad_symbol);
-			printf("Wrong! %s\r\n", cw[sym].symbol);
-		}
+	/* last, so the trace buffer is locked too */
+	rt_lock_memory();
+
+	/* an answer is never lost to a crash once this is running */
+	if (journal_start() < 0)
+		fprintf(stderr, "journal: cannot write, the weights are saved only at exit\n");
+
+	run_flag = 1;
+	rc = start_threads();
+	if (rc) {
+		fprintf(stderr, "pthread_create: %s\n", strerror(rc));
+		journal_stop();
+		reactor_destroy(&reactor);
+		worker_fini();
+		audio_fini();
+		sq_fini();
+		tty_fini();
+		exit(1);
 	}
+	rt_report();
 
-	join_threads();
+	drill_next(0);
+	reactor_run(&reactor);
 
+	run_flag = 0;
+	audio_stop();
+	join_threads();
+	rtlog_drain(stderr);
+#ifdef QUEUE_STATS
+	audio_report(reactor.wakeups);
+#endif
+	latency_report(stderr);
+	prof_fini();
+
+	reactor_destroy(&reactor);
 	worker_fini();
-	alsa_fini();
+	audio_fini();
 	sq_fini();
 	tty_fini();
+	feedback_free();
 	symbols_destroy();
+	chooser_fini();
+	dict_close(&dictionary);
 
-	config_write();
+	journal_stop();
 
 	return 0;
 }
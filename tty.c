@@ -35,7 +35,7 @@ int tty_init(void)
 {
 	struct termios term;
 
-	tty = open(TTY, O_RDWR | O_NOCTTY /* | O_NONBLOCK */);
+	tty = open(TTY, O_RDWR | O_NOCTTY | O_NONBLOCK);
 	assert(tty != -1);
 
 	if (tcgetattr(tty, &term) != 0) {
@@ -81,6 +81,15 @@ void tty_fini(void)
 	tcsetattr(tty, TCSANOW, &term_save);
 }
 
+/*
+ * For poll(2): the tty is non-blocking, so read it only
+ * once it is readable.
+ */
+int tty_fd(void)
+{
+	return tty;
+}
+
 int tty_read(unsigned char *buf, int len)
 {
 	int n;
@@ -92,6 +101,10 @@ int tty_read(unsigned char *buf, int len)
 			rc = (errno == EAGAIN) ? 0 : -1;
 			break;
 		}
+		if (n == 0) {		/* hangup */
+			rc = -1;
+			break;
+		}
 		len -= n;
 		buf += n;
 		if (len > 0)
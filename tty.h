@@ -17,6 +17,7 @@
 
 extern int tty_init(void);
 extern void tty_fini(void);
+extern int tty_fd(void);
 extern int tty_read(unsigned char *buf, int len);
 
 #endif
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2018 by Ross Wille. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * COPYING file for more details.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pcm.h"
+#include "wav.h"
+
+#define WAV_FORMAT_PCM		1
+#define WAV_FORMAT_FLOAT	3
+
+static void put_le16(unsigned char *p, unsigned int v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static void put_le32(unsigned char *p, unsigned int v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+/*
+ * Canonical header: RIFF, "fmt " and "data" chunks
+ */
+static void wav_header(unsigned char *hdr, const struct wav_struct *wp)
+{
+	int sample_size = pcm_sample_size(wp->format);
+	int frame_size = wp->n_chans * sample_size;
+
+	memcpy(&hdr[0], "RIFF", 4);
+	put_le32(&hdr[4], WAV_HDR_SIZE - 8 + wp->bytes);
+	memcpy(&hdr[8], "WAVE", 4);
+	memcpy(&hdr[12], "fmt ", 4);
+	put_le32(&hdr[16], 16);
+	put_le16(&hdr[20], (wp->format == PCM_FLOAT) ? WAV_FORMAT_FLOAT : WAV_FORMAT_PCM);
+	put_le16(&hdr[22], wp->n_chans);
+	put_le32(&hdr[24], wp->rate);
+	put_le32(&hdr[28], wp->rate * frame_size);
+	put_le16(&hdr[32], frame_size);
+	put_le16(&hdr[34], 8 * sample_size);
+	memcpy(&hdr[36], "data", 4);
+	put_le32(&hdr[40], wp->bytes);
+}
+
+int wav_create(struct wav_struct *wp, const char *fn, int rate, int n_chans,
+	int format)
+{
+	unsigned char hdr[WAV_HDR_SIZE];
+
+	wp->rate = rate;
+	wp->n_chans = n_chans;
+	wp->format = format;
+	wp->bytes = 0;
+
+	wp->fp = fopen(fn, "w");
+	if (wp->fp == NULL)
+		return -1;
+
+	/* the sizes are patched by wav_close() */
+	wav_header(hdr, wp);
+	if (fwrite(hdr, sizeof(hdr), 1, wp->fp) != 1) {
+		fclose(wp->fp);
+		wp->fp = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+int wav_write(struct wav_struct *wp, const void *buf, int frames)
+{
+	int len = frames * wp->n_chans * pcm_sample_size(wp->format);
+
+	if (fwrite(buf, 1, len, wp->fp) != len)
+		return -1;
+	wp->bytes += len;
+
+	return 0;
+}
+
+/*
+ * Silence, left as a hole in the file: every format is signed,
+ * so zero bytes are silence.  Takes the same time for any
+ * length.
+ */
+int wav_skip(struct wav_struct *wp, long frames)
+{
+	long len = frames * wp->n_chans * pcm_sample_size(wp->format);
+
+	if (fseek(wp->fp, len, SEEK_CUR) != 0)
+		return -1;
+	wp->bytes += len;
+
+	return 0;
+}
+
+int wav_close(struct wav_struct *wp)
+{
+	unsigned char hdr[WAV_HDR_SIZE];
+	int rc = 0;
+
+	if (wp->fp == NULL)
+		return -1;
+
+	/* a hole at the end is only part of the file once it is sized */
+	if ((fflush(wp->fp) != 0) ||
+	    (ftruncate(fileno(wp->fp), WAV_HDR_SIZE + (off_t)wp->bytes) != 0))
+		rc = -1;
+
+	wav_header(hdr, wp);
+	if ((fseek(wp->fp, 0, SEEK_SET) != 0) ||
+	    (fwrite(hdr, sizeof(hdr), 1, wp->fp) != 1))
+		rc = -1;
+	if (fclose(wp->fp) != 0)
+		rc = -1;
+	wp->fp = NULL;
+
+	return rc;
+}
@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) 2018 by Ross Wille. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * COPYING file for more details.
+ */
+
+#ifndef _WAV_H_
+#define _WAV_H_
+
+#include <stdio.h>
+
+#define WAV_HDR_SIZE		44
+
+struct wav_struct {
+	FILE *fp;
+	int rate;
+	int n_chans;
+	int format;		/* PCM_* */
+	unsigned int bytes;	/* PCM bytes written so far */
+};
+
+extern int wav_create(struct wav_struct *wp, const char *fn, int rate, int n_chans,
+	int format);
+extern int wav_write(struct wav_struct *wp, const void *buf, int frames);
+extern int wav_skip(struct wav_struct *wp, long frames);
+extern int wav_close(struct wav_struct *wp);
+
+#endif